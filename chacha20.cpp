@@ -0,0 +1,297 @@
+// chacha20.cpp --- ChaCha20 keystream as a random engine
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+// ChaCha20 as specified by D. J. Bernstein, "ChaCha, a variant of Salsa20" (2008):  a
+// 16-word state of 4 constants, 8 key words, a 64-bit block counter and a 64-bit nonce,
+// 20 rounds (10 double rounds), then the input state is added to the result.
+//
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include "pw_rng.h"
+#include "pw_cpu.h"
+
+
+constexpr std::array<std::uint32_t,4> chacha20_sigma {  // "expand 32-byte k"
+	0x61707865, 0x3320646e, 0x79622d32, 0x6b206574
+};
+
+constexpr std::uint32_t rotl32(std::uint32_t x, int n) {
+	return (x << n) | (x >> (32-n));
+}
+
+inline void quarter_round(std::array<std::uint32_t,16>& x, int a, int b, int c, int d) {
+	x[a] += x[b];  x[d] ^= x[a];  x[d] = rotl32(x[d],16);
+	x[c] += x[d];  x[b] ^= x[c];  x[b] = rotl32(x[b],12);
+	x[a] += x[b];  x[d] ^= x[a];  x[d] = rotl32(x[d],8);
+	x[c] += x[d];  x[b] ^= x[c];  x[b] = rotl32(x[b],7);
+}
+
+std::array<std::uint32_t,16> chacha20_state(const chacha20_key_t& key, std::uint64_t stream,
+												std::uint64_t ctr) {
+	std::array<std::uint32_t,16> s {};
+	std::copy(chacha20_sigma.begin(),chacha20_sigma.end(),s.begin());
+	std::copy(key.begin(),key.end(),s.begin()+4);
+	s[12] = static_cast<std::uint32_t>(ctr);
+	s[13] = static_cast<std::uint32_t>(ctr >> 32);
+	s[14] = static_cast<std::uint32_t>(stream);
+	s[15] = static_cast<std::uint32_t>(stream >> 32);
+	return s;
+}
+
+void chacha20_blocks_scalar(const chacha20_key_t& key, std::uint64_t stream, std::uint64_t ctr,
+								std::size_t n, std::uint32_t *dest) {
+	for (std::size_t j=0; j<n; ++j, ++ctr, dest += 16) {
+		const auto in = chacha20_state(key,stream,ctr);
+		auto x = in;
+		for (int i=0; i<10; ++i) {
+			quarter_round(x,0,4,8,12);
+			quarter_round(x,1,5,9,13);
+			quarter_round(x,2,6,10,14);
+			quarter_round(x,3,7,11,15);
+			quarter_round(x,0,5,10,15);
+			quarter_round(x,1,6,11,12);
+			quarter_round(x,2,7,8,13);
+			quarter_round(x,3,4,9,14);
+		}
+		for (int i=0; i<16; ++i) {
+			dest[i] = x[i] + in[i];
+		}
+	}
+}
+
+#if PW_HAVE_X86
+//
+// 8 blocks at once:  vector i holds state word i of blocks ctr..ctr+7 (lane j == block
+// ctr+j), so the rounds are the scalar rounds w/ each word op done 8-wide.  Rotations by
+// 16 and 8 are byte shuffles.  The result is transposed back to block order on the way out.
+//
+PW_TARGET_AVX2
+inline __m256i rotl_avx2(__m256i x, int n) {
+	return _mm256_or_si256(_mm256_slli_epi32(x,n),_mm256_srli_epi32(x,32-n));
+}
+
+PW_TARGET_AVX2
+void chacha20_blocks8_avx2(const chacha20_key_t& key, std::uint64_t stream, std::uint64_t ctr,
+								std::uint32_t *dest) {
+	const auto s = chacha20_state(key,stream,ctr);
+	alignas(32) std::uint32_t ctr_lo[8];
+	alignas(32) std::uint32_t ctr_hi[8];
+	for (int j=0; j<8; ++j) {
+		ctr_lo[j] = static_cast<std::uint32_t>(ctr+j);
+		ctr_hi[j] = static_cast<std::uint32_t>((ctr+j) >> 32);
+	}
+
+	__m256i in[16];
+	for (int i=0; i<16; ++i) {
+		in[i] = _mm256_set1_epi32(static_cast<int>(s[i]));
+	}
+	in[12] = _mm256_load_si256(reinterpret_cast<const __m256i*>(ctr_lo));
+	in[13] = _mm256_load_si256(reinterpret_cast<const __m256i*>(ctr_hi));
+
+	const __m256i rot16 = _mm256_setr_epi8(2,3,0,1, 6,7,4,5, 10,11,8,9, 14,15,12,13,
+		2,3,0,1, 6,7,4,5, 10,11,8,9, 14,15,12,13);
+	const __m256i rot8 = _mm256_setr_epi8(3,0,1,2, 7,4,5,6, 11,8,9,10, 15,12,13,14,
+		3,0,1,2, 7,4,5,6, 11,8,9,10, 15,12,13,14);
+	__m256i x[16];
+	for (int i=0; i<16; ++i) {
+		x[i] = in[i];
+	}
+	auto qr = [&x,&rot16,&rot8](int a, int b, int c, int d) PW_TARGET_AVX2 -> void {
+		x[a] = _mm256_add_epi32(x[a],x[b]);
+		x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d],x[a]),rot16);
+		x[c] = _mm256_add_epi32(x[c],x[d]);
+		x[b] = rotl_avx2(_mm256_xor_si256(x[b],x[c]),12);
+		x[a] = _mm256_add_epi32(x[a],x[b]);
+		x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d],x[a]),rot8);
+		x[c] = _mm256_add_epi32(x[c],x[d]);
+		x[b] = rotl_avx2(_mm256_xor_si256(x[b],x[c]),7);
+	};
+	for (int i=0; i<10; ++i) {
+		qr(0,4,8,12);
+		qr(1,5,9,13);
+		qr(2,6,10,14);
+		qr(3,7,11,15);
+		qr(0,5,10,15);
+		qr(1,6,11,12);
+		qr(2,7,8,13);
+		qr(3,4,9,14);
+	}
+
+	alignas(32) std::uint32_t words[16][8];
+	for (int i=0; i<16; ++i) {
+		_mm256_store_si256(reinterpret_cast<__m256i*>(words[i]),_mm256_add_epi32(x[i],in[i]));
+	}
+	for (int j=0; j<8; ++j) {
+		for (int i=0; i<16; ++i) {
+			dest[16*j+i] = words[i][j];
+		}
+	}
+}
+#endif
+
+
+chacha20_engine::chacha20_engine() : chacha20_engine(os_key(),0) {}
+
+chacha20_engine::chacha20_engine(const chacha20_key_t& k, std::uint64_t s)
+	: key(k), stream(s) {
+	simd = cpu_has_avx2();
+}
+
+chacha20_key_t chacha20_engine::os_key() {
+	std::random_device rd {};
+	chacha20_key_t k {};
+	for (auto& w : k) {
+		w = rd();
+	}
+	return k;
+}
+
+void chacha20_engine::keystream(std::uint64_t ctr, std::size_t n, std::uint32_t *dest) const {
+#if PW_HAVE_X86
+	if (simd) {
+		for (; n >= 8; n -= 8, ctr += 8, dest += 8*16) {
+			chacha20_blocks8_avx2(key,stream,ctr,dest);
+		}
+	}
+#endif
+	chacha20_blocks_scalar(key,stream,ctr,n,dest);
+}
+
+void chacha20_engine::seek(std::uint64_t s) {
+	stream = s;
+	counter = 0;
+	discard_buffer();
+}
+
+std::size_t chacha20_engine::refill(std::uint32_t *dest, std::size_t n) {
+	const std::size_t nblocks = n/16;
+	keystream(counter,nblocks,dest);
+	counter += nblocks;
+	return nblocks*16;
+}
+
+
+#if defined(TEST)
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+//
+// Keystream test vectors:  RFC 8439 A.1 test vector #1 (all-zero key, nonce and counter) and
+// RFC 8439 2.3.2 (key 00..1f; its 96-bit nonce 000000090000004a00000000 and 32-bit
+// counter 1 map to a 64-bit counter of 0x0900000000000001 and a 64-bit nonce of 0x4a000000).
+//
+int main() {
+	struct vector_t {
+		chacha20_key_t key;
+		std::uint64_t stream;
+		std::uint64_t ctr;
+		std::array<std::uint32_t,16> expect;
+	};
+	chacha20_key_t k2 {};
+	for (int i=0; i<8; ++i) {
+		k2[i] = (4*i) | ((4*i+1) << 8) | ((4*i+2) << 16) | ((4*i+3) << 24);
+	}
+	const std::array<vector_t,2> vectors {{
+		{chacha20_key_t {}, 0, 0, {
+			0xade0b876, 0x903df1a0, 0xe56a5d40, 0x28bd8653, 0xb819d2bd, 0x1aed8da0, 0xccef36a8, 0xc70d778b,
+			0x7c5941da, 0x8d485751, 0x3fe02477, 0x374ad8b8, 0xf4b8436a, 0x1ca11815, 0x69b687c3, 0x8665eeb2}},
+		{k2, 0x4a000000, 0x0900000000000001, {
+			0xe4e7f110, 0x15593bd1, 0x1fdd0f50, 0xc47120a3, 0xc7f4d1c7, 0x0368c033, 0x9aaa2204, 0x4e6cd4c3,
+			0x466482d2, 0x09aa9f07, 0x05d7c214, 0xa2028bd9, 0xd19c12b5, 0xb94e16de, 0xe883d0cb, 0x4e3c50a2}}
+	}};
+
+	printf( "\n ChaCha20 Validation Tests:\n\n" );
+	int nfail {0};
+	for (int simd=0; simd<2; ++simd) {
+		if (simd && !cpu_has_avx2()) {
+			printf( " AVX2 not supported; skipped\n" );
+			continue;
+		}
+		for (std::size_t i=0; i<vectors.size(); ++i) {
+			printf( " Test %zu (%s) ", i + 1, (simd ? "avx2" : "scalar") );
+			chacha20_engine re(vectors[i].key,vectors[i].stream);
+			re.simd = simd;
+			std::array<std::uint32_t,16*9> ks {};  // 9 blocks => both the 8-wide and scalar paths
+			re.keystream(vectors[i].ctr-4,ks.size()/16,ks.data());
+			if (std::memcmp(ks.data()+4*16,vectors[i].expect.data(),64) != 0) {
+				printf( "failed!\n" );
+				++nfail;
+				continue;
+			}
+			printf( "passed.\n" );
+		}
+	}
+
+	// The engine hands out the keystream words in order
+	chacha20_engine re(chacha20_key_t {},0);
+	for (int i=0; i<16; ++i) {
+		if (re() != vectors[0].expect[i]) {
+			printf( " Engine output failed!\n" );
+			++nfail;
+			break;
+		}
+	}
+	// After a seek() the engine hands out the new stream from its first word
+	chacha20_engine fresh(chacha20_key_t {},5);
+	re.seek(5);
+	for (int i=0; i<1000; ++i) {
+		if (re() != fresh()) {
+			printf( " Engine seek failed!\n" );
+			++nfail;
+			break;
+		}
+	}
+
+	// below():  in range, uniform (chi2 w/in 6 sigma), 12 bits a digit, and the bit buffer 
+	// restarts w/ the stream on a seek()
+	printf( "\n below() Tests:\n\n" );
+	for (const std::uint32_t n : {3u, 10u, 62u, 1000u}) {
+		chacha20_engine br(chacha20_key_t {1},0);
+		const int per {1000};
+		std::vector<int> counts(n,0);
+		bool in_range {true};
+		for (std::uint32_t i=0; i<n*per; ++i) {
+			const std::uint32_t x = br.below(n);
+			in_range = in_range && x < n;
+			if (x < n) { ++counts[x]; }
+		}
+		double chi2 {0.0};
+		for (const auto& c : counts) {
+			chi2 += (c-per)*(c-per)/static_cast<double>(per);
+		}
+		const double bits = 32.0*br.draws()/(n*per);
+		const bool ok = in_range && chi2 < (n-1) + 6*std::sqrt(2.0*(n-1))
+			&& bits < (pw_bit_width(n-1) + 8)*1.01;
+		printf( " n = %-5u chi2 %8.1f (dof %u), %5.2f bits a draw %s\n", n, chi2, n-1, bits,
+			ok ? "passed." : "failed!" );
+		nfail += ok ? 0 : 1;
+	}
+	chacha20_engine br(chacha20_key_t {1},0);
+	bool big_ok {true};
+	for (int i=0; i<100000; ++i) {
+		big_ok = big_ok && br.below(0xFFFFFFFFu) < 0xFFFFFFFFu && br.below(1) == 0;
+		const double u = br.uniform01();
+		big_ok = big_ok && u >= 0.0 && u < 1.0;
+	}
+	chacha20_engine bfresh(chacha20_key_t {1},7);
+	br.below(10);  // Leaves bits in the buffer
+	br.seek(7);
+	for (int i=0; i<1000; ++i) {
+		big_ok = big_ok && br.below(10) == bfresh.below(10);
+	}
+	printf( " Wide ranges, uniform01() and seek() %s\n", big_ok ? "passed." : "failed!" );
+	nfail += big_ok ? 0 : 1;
+	printf( "\n" );
+
+	return nfail == 0 ? 0 : 1;
+}
+
+#endif
+
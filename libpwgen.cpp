@@ -0,0 +1,141 @@
+// libpwgen.cpp -- the C interface:  a pw_generator_t behind an opaque pointer
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+
+#include <string>
+#include <exception>
+#include <cstring>  // std::memcpy()
+#include <cstddef>
+#include "pwgen.h"
+#include "libpwgen.h"
+
+
+struct pwgen {
+	pw_generator_t gen;
+	pw_batch_t batch {};  // pwgen_fill_batch()'s, reused; wiped after each call
+};
+
+// No exception crosses into C:  each call catches them all and keeps the message
+thread_local std::string pwgen_last_error {};
+
+template<typename F>
+auto pwgen_guard(F f, decltype(f()) on_error) -> decltype(f()) {
+	try {
+		return f();
+	} catch (const std::exception& e) {
+		pwgen_last_error = e.what();
+	} catch (...) {
+		pwgen_last_error = "Unknown error";
+	}
+	return on_error;
+}
+
+pwgen_t *pwgen_new(const char *options) {
+	return pwgen_guard([options]() -> pwgen_t* {
+		return new pwgen {make_generator(options ? options : "")};
+	}, nullptr);
+}
+
+std::size_t pwgen_length(const pwgen_t *pg) {
+	return pg->gen.opts().pw_length;
+}
+
+std::size_t pwgen_next(pwgen_t *pg, char *dest, std::size_t size) {
+	const std::size_t len = pwgen_length(pg);
+	if (size <= len) {
+		pwgen_last_error = "Buffer too small for the password and its '\\0'";
+		return 0;
+	}
+	return pwgen_guard([pg,dest,len]() -> std::size_t {
+		pg->gen.next(dest);
+		dest[len] = '\0';
+		return len;
+	}, 0);
+}
+
+// The arena is wiped however the call ends, so no passwd outlives it in the heap (nor in a 
+// block freed when a larger batch grows it)
+int pwgen_fill_batch(pwgen_t *pg, char *dest, std::size_t n) {
+	struct wipe_t {
+		pw_batch_t& batch;
+		~wipe_t() { pw_wipe(batch.chars.data(),batch.chars.size()); }
+	};
+	if (n == 0) {
+		return 0;
+	}
+	return pwgen_guard([pg,dest,n]() -> int {
+		wipe_t wipe {pg->batch};
+		pg->gen.fill_batch(n,pg->batch);
+		std::memcpy(dest,pg->batch.chars.data(),pg->batch.chars.size());
+		return 0;
+	}, -1);
+}
+
+void pwgen_free(pwgen_t *pg) {
+	delete pg;
+}
+
+const char *pwgen_error(void) {
+	return pwgen_last_error.c_str();
+}
+
+
+#if defined(TEST)
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+//
+// 1) A seeded generator gives the same passwds one by one as in batches (of both sizes, 
+//    and an empty one), i.e. the passwds of the pwgen run w/ that seed, in order; the 
+//    batches leave nothing in the generator's arena.
+// 2) Invalid options fail w/ a message instead of exiting.
+//
+int main() {
+	int nfail {0};
+	printf( "\n libpwgen Tests:\n\n" );
+
+	for (const char *options : {"--seed=42 12", "-sy --seed=7 16", "-H /dev/null#x 10"}) {
+		pwgen_t *a = pwgen_new(options);
+		pwgen_t *b = pwgen_new(options);
+		bool ok = (a && b);
+		const std::size_t len = ok ? pwgen_length(a) : 0;
+		std::string one {};
+		std::vector<char> pw(len+1);
+		for (int i=0; ok && i<3000; ++i) {
+			ok = (pwgen_next(a,pw.data(),pw.size()) == len);
+			one.append(pw.data(),len);
+		}
+		std::string batch(3000*len,'\0');
+		ok = ok && pwgen_fill_batch(b,batch.data(),10) == 0 && pwgen_fill_batch(b,nullptr,0) == 0;
+		ok = ok && pwgen_fill_batch(b,batch.data()+10*len,2990) == 0;
+		ok = ok && std::all_of(b->batch.chars.begin(),b->batch.chars.end(),
+			[](char c) -> bool { return c == '\0'; });  // The arena is wiped
+		printf( " Test 1 (%s) %s\n", options, (ok && one == batch) ? "passed." : "failed!" );
+		nfail += (ok && one == batch) ? 0 : 1;
+		pwgen_free(a);
+		pwgen_free(b);
+	}
+
+	for (const char *options : {"-q", "-s -r abcdefghijklmnopqrstuvwxyz 8 -0A", "--index=3 8", "0"}) {
+		pwgen_t *pg = pwgen_new(options);
+		const bool ok = (pg == nullptr && std::strlen(pwgen_error()) > 0);
+		printf( " Test 2 (%s):  %s %s\n", options, pwgen_error(), ok ? "passed." : "failed!" );
+		nfail += ok ? 0 : 1;
+		pwgen_free(pg);
+	}
+
+	pwgen_t *pg = pwgen_new("");
+	char small[4] {};
+	const bool ok = (pg && pwgen_next(pg,small,sizeof(small)) == 0);
+	printf( " Test 3 (short buffer) %s\n", ok ? "passed." : "failed!" );
+	nfail += ok ? 0 : 1;
+	pwgen_free(pg);
+	printf( "\n" );
+
+	return nfail == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+// libpwgen.h --- C interface to the password generators
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+// A pwgen_t is made once from the options of a pwgen command line, which pwgen_new() parses,
+// compiles into tables and keys from the OS (or --seed, or -H); pwgen_next() then costs
+// about what the same passwd costs in pwgen itself.  A pwgen_t is used by one thread at a
+// time.  libpwgen is C++ inside, so programs link it w/ the C++ runtime.
+//
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pwgen pwgen_t;
+
+// options as for pwgen, w/o the program name and split at whitespace:  "-sy -r O0 16", or
+// "--seed=42 12" for the passwds of pwgen --seed=42 12 in order.  The options that only
+// concern a run (num_pw, -C, --output, --stream, --unique, ...) are parsed and ignored.
+// NULL => invalid options; see pwgen_error().
+pwgen_t *pwgen_new(const char *options);
+size_t pwgen_length(const pwgen_t *);  // Chars per passwd
+// Writes the next passwd and a '\0' to dest[0, size); returns its length, or 0 on error
+size_t pwgen_next(pwgen_t *, char *dest, size_t size);
+// Writes the next n passwds back to back, pwgen_length() chars each w/o separators or '\0',
+// to dest; on --threads=<k> threads.  Returns 0 (also for n == 0), or -1 on error.
+int pwgen_fill_batch(pwgen_t *, char *dest, size_t n);
+void pwgen_free(pwgen_t *);
+const char *pwgen_error(void);  // Why this thread's last call failed
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,327 @@
+// pw_args.cpp -- pwgen's command line:  options, usage, and the streams of a run
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <charconv>
+#include <thread>
+#include <cstdint>
+#include "pwgen.h"
+
+
+enum long_only_opt {
+	opt_threads = 256,
+	opt_seed,
+	opt_output,
+	opt_constructive,
+	opt_dump_phonemes,
+	opt_stats,
+	opt_index,
+	opt_sha1_tree,
+	opt_entropy,
+	opt_unique,
+	opt_stream,
+	opt_serve
+};
+enum arg_kind {  // As getopt_long()'s has_arg
+	no_arg,
+	required_arg,
+	optional_arg  // Only as --name=arg
+};
+struct long_opt_t {
+	const char *name {nullptr};
+	arg_kind has_arg {no_arg};
+	int val {0};  // The equivalent short option, or a long_only_opt
+};
+const std::vector<long_opt_t> pw_long_opts {
+	{"alt-phonics", no_arg, 'a'},
+	{"capitalize", no_arg, 'c'},
+	{"numerals", no_arg, 'n'},
+	{"symbols", no_arg, 'y'},
+	{"num-passwords", required_arg, 'N'},
+	{"remove-chars", required_arg, 'r'},
+	{"secure", no_arg, 's'},
+	{"help", no_arg, 'h'},
+	{"no-numerals", no_arg, '0'},
+	{"no-capitalize", no_arg, 'A'},
+	{"sha1", required_arg, 'H'},
+	{"ambiguous", no_arg, 'B'},
+	{"no-vowels", no_arg, 'v'},
+	{"threads", required_arg, opt_threads},
+	{"seed", required_arg, opt_seed},
+	{"output", required_arg, opt_output},
+	{"constructive", no_arg, opt_constructive},
+	{"dump-phonemes", no_arg, opt_dump_phonemes},
+	{"stats", optional_arg, opt_stats},
+	{"index", required_arg, opt_index},
+	{"sha1-tree", no_arg, opt_sha1_tree},
+	{"entropy", no_arg, opt_entropy},
+	{"unique", no_arg, opt_unique},
+	{"stream", no_arg, opt_stream},
+	{"serve", required_arg, opt_serve}
+};
+const std::string pw_short_opts {"01AaBCcnN:sr:hH:vy"};  // getopt() syntax
+
+// A --seed is a key:  a decimal number < 2^64, or 0x and up to 64 hex digits for all 256 
+// bits.  Either way the number's low 32 bits are word 0 of the key, and so on up, so 42 
+// and 0x2a are the same seed.  
+bool parse_seed(const std::string& s, chacha20_key_t& key) {
+	key = chacha20_key_t {};
+	if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+		const std::size_t n = s.size() - 2;
+		if (n > 8*key.size()) {
+			return false;
+		}
+		for (std::size_t i=0; i<key.size() && 8*i<n; ++i) {  // Word i from the right
+			const std::size_t end = s.size() - 8*i;
+			const std::size_t begin = end - std::min(end - 2,std::size_t {8});
+			auto [p, ec] = std::from_chars(s.data()+begin,s.data()+end,key[i],16);
+			if (ec != std::errc {} || p != s.data()+end) {
+				return false;
+			}
+		}
+		return true;
+	}
+	std::uint64_t x {0};
+	auto [p, ec] = std::from_chars(s.data(),s.data()+s.size(),x);
+	key[0] = static_cast<std::uint32_t>(x);
+	key[1] = static_cast<std::uint32_t>(x >> 32);
+	return (ec == std::errc {} && p == s.data()+s.size());
+}
+
+// Parses args in the style of getopt_long():  short options may be grouped (-sy), and an 
+// option argument may be attached (-r0O, --threads=4) or the next arg (-r 0O, --threads 4).  
+// Throws a pw_error naming the first invalid option or argument.  
+void parse_args(const std::vector<std::string>& args, pw_opts_t& opts, run_opts_t& run) {
+	auto to_int = [](const std::string& s, auto& dest) -> bool {
+		auto [p, ec] = std::from_chars(s.data(),s.data()+s.size(),dest);
+		return (ec == std::errc {} && p == s.data()+s.size());
+	};
+	auto apply = [&](int opt, const std::string& arg) -> bool {
+		switch (opt) {
+			case '0':  opts.digits = false;  break;
+			case 'A':  opts.uppers = false;  break;
+			case 'a':  break;
+			case 'B':  opts.no_ambiguous = true;  break;
+			case 'C':  opts.cols = true;  run.cols_set = true;  break;
+			case 'c':  opts.uppers = true;  break;
+			case 'n':  opts.digits = true;  break;
+			case 'N':  return to_int(arg,opts.num_pw);
+			case 's':  opts.random = true;  break;
+			case 'r':  opts.remove_chars = arg;  break;
+			case 'h':  run.help = true;  break;
+			case 'H':  run.sha1 = arg;  break;
+			case 'v':  opts.no_vowels = true;  break;
+			case 'y':  opts.symbols = true;  break;
+			case '1':  opts.cols = false;  run.cols_set = true;  break;
+			case opt_threads:  
+				run.threads_set = true;
+				return (to_int(arg,run.threads) && run.threads >= 0 && run.threads <= pw_max_threads);
+			case opt_seed:  run.have_seed = true;  return parse_seed(arg,run.seed);
+			case opt_index:  run.have_index = true;  return to_int(arg,run.index);
+			case opt_sha1_tree:  run.sha1_tree = true;  break;
+			case opt_entropy:  run.entropy = true;  break;
+			case opt_unique:  run.unique = true;  break;
+			case opt_stream:  run.stream = true;  break;
+			case opt_serve:  run.serve = arg;  return (arg.size() > 0);
+			case opt_output:  run.output = arg;  return (arg.size() > 0);
+			case opt_constructive:  opts.constructive = true;  break;
+			case opt_dump_phonemes:  run.dump_phonemes = true;  break;
+			case opt_stats:
+				run.stats = true;
+				run.stats_json = (arg == "json");
+				return (arg.size() == 0 || arg == "json");
+			default:  return false;
+		}
+		return true;
+	};
+
+	std::vector<std::string> positional {};
+	const std::size_t argc = args.size();
+	for (std::size_t i=0; i<argc; ++i) {
+		const std::string& curr = args[i];
+		if (curr.size() < 2 || curr[0] != '-') {
+			positional.push_back(curr);
+		} else if (curr == "--") {
+			positional.insert(positional.end(),args.begin()+i+1,args.end());
+			break;
+		} else if (curr[1] == '-') {  // --name[=arg]
+			auto eq = curr.find('=');
+			auto name = curr.substr(2,eq-2);
+			auto lopt = std::find_if(pw_long_opts.begin(),pw_long_opts.end(),
+				[&name](const long_opt_t& o) -> bool { return name == o.name; });
+			if (lopt == pw_long_opts.end()) {
+				throw pw_error("Unrecognized option " + curr);
+			}
+			std::string arg {};
+			if (lopt->has_arg == no_arg && eq != std::string::npos) {
+				throw pw_error("Option --" + name + " doesn't take an argument");
+			} else if (lopt->has_arg == optional_arg && eq != std::string::npos) {
+				arg = curr.substr(eq+1);
+			} else if (lopt->has_arg == required_arg) {
+				if (eq != std::string::npos) {
+					arg = curr.substr(eq+1);
+				} else if (i+1 < argc) {
+					arg = args[++i];
+				} else {
+					throw pw_error("Option --" + name + " requires an argument");
+				}
+			}
+			if (!apply(lopt->val,arg)) {
+				throw pw_error("Invalid argument to --" + name);
+			}
+		} else {  // -abc, -r<arg>, -r <arg>
+			for (std::size_t j=1; j<curr.size(); ++j) {
+				auto sopt = pw_short_opts.find(curr[j]);
+				if (curr[j] == ':' || sopt == std::string::npos) {
+					throw pw_error(std::string("Unrecognized option -") + curr[j]);
+				}
+				std::string arg {};
+				bool has_arg = (sopt+1 < pw_short_opts.size() && pw_short_opts[sopt+1] == ':');
+				if (has_arg) {
+					if (j+1 < curr.size()) {
+						arg = curr.substr(j+1);
+					} else if (i+1 < argc) {
+						arg = args[++i];
+					} else {
+						throw pw_error(std::string("Option -") + curr[j] + " requires an argument");
+					}
+				}
+				if (!apply(curr[j],arg)) {
+					throw pw_error(std::string("Invalid argument to -") + curr[j]);
+				}
+				if (has_arg) { break; }
+			}
+		}
+	}
+
+	if (positional.size() > 2) {
+		throw pw_error("Too many arguments");
+	}
+	if (positional.size() > 0 && !to_int(positional[0],opts.pw_length)) {
+		throw pw_error("Invalid password length " + positional[0]);
+	}
+	if (positional.size() > 1 && !to_int(positional[1],opts.num_pw)) {
+		throw pw_error("Invalid number of passwords " + positional[1]);
+	}
+	// As for the profiles of a request:  a daemon's passwds must not be reproducible
+	if (run.serve.size() > 0 && (run.have_seed || run.sha1.size() > 0)) {
+		throw pw_error("--serve can't be used w/ --seed or -H");
+	}
+	if (run.serve.size() > 0 && opts.pw_length > pw_serve_max_length) {
+		throw pw_error("--serve passwords are at most " + std::to_string(pw_serve_max_length) 
+			+ " chars");
+	}
+}
+
+void parse_args(int argc, char **argv, pw_opts_t& opts, run_opts_t& run) {
+	parse_args(std::vector<std::string>(argv+1,argv+argc),opts,run);
+}
+
+// Split at whitespace; there is no quoting, so an -r set can't include a space
+void parse_args(const std::string& options, pw_opts_t& opts, run_opts_t& run) {
+	std::istringstream ss {options};
+	parse_args(std::vector<std::string>(std::istream_iterator<std::string>(ss),
+		std::istream_iterator<std::string>()),opts,run);
+}
+
+pw_streams_t make_streams(const run_opts_t& run) {
+	pw_streams_t streams {{}, 0, run.threads};
+	if (streams.nthreads == 0) {
+		streams.nthreads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()),1,
+			pw_max_threads);
+	}
+	// The ChaCha20 key for the run:  --seed, or (w/o -H, which has a key of its own) from 
+	// the OS
+	if (run.have_seed) {
+		streams.key = run.seed;
+	} else if (run.sha1.size() == 0) {
+		streams.key = chacha20_engine::os_key();
+	}
+	if (run.sha1.size() > 0) {
+		if (run.have_seed) {
+			throw pw_error("-H and --seed can't be used together");
+		}
+		// The tree's digest doesn't depend on the threads that hash it
+		const int nhash = run.threads_set ? streams.nthreads 
+			: std::max(static_cast<int>(std::thread::hardware_concurrency()),1);
+		if (!pw_sha1_init(run.sha1,streams.digest,run.sha1_tree,nhash)) {
+			throw pw_error("Couldn't open file: " + run.sha1.substr(0,run.sha1.find('#')));
+		}
+		streams.sha1 = true;
+	}
+	streams.seekable = run.have_seed || streams.sha1;
+	if (run.have_index && !streams.seekable) {
+		throw pw_error("--index needs --seed or -H");
+	}
+	streams.first = run.index;
+	return streams;
+}
+
+std::string usage() {
+	std::string s {};
+
+	s += "Usage: pwgen [ OPTIONS ] [ pw_length ] [ num_pw ]\n\n";
+	s += "Options supported by pwgen:\n";
+	s += "  -c or --capitalize\n";
+	s += "\tInclude at least one capital letter in the password\n";
+	s += "  -A or --no-capitalize\n";
+	s += "\tDon't include capital letters in the password\n";
+	s += "  -n or --numerals\n";
+	s += "\tInclude at least one number in the password\n";
+	s += "  -0 or --no-numerals\n";
+	s += "\tDon't include numbers in the password\n";
+	s += "  -y or --symbols\n";
+	s += "\tInclude at least one special symbol in the password\n";
+	s += "  -r <chars> or --remove-chars=<chars>\n";
+	s += "\tRemove characters from the set of characters to generate passwords\n";
+	s += "  -s or --secure\n";
+	s += "\tGenerate completely random passwords\n";
+	s += "  -B or --ambiguous\n";
+	s += "\tDon't include ambiguous characters in the password\n";
+	s += "  -h or --help\n";
+	s += "\tPrint a help message\n";
+	s += "  -H or --sha1=path/to/file[#seed]\n";
+	s += "\tUse sha1 hash of given file as a (not so) random generator\n";
+	s += "  --sha1-tree\n";
+	s += "\tWith -H, hash the file as a tree of 1 MiB leaves on --threads threads (default:\n";
+	s += "\tevery core); a different key\n";
+	s += "  -C\n\tPrint the generated passwords in columns\n";
+	s += "  -1\n\tDon't print the generated passwords in columns\n";
+	s += "  -v or --no-vowels\n";
+	s += "\tDo not use any vowels so as to avoid accidental nasty words\n";
+	s += "  --constructive\n";
+	s += "\tWith -s, build each password w/o redrawing ones that lack a required class (up\n";
+	s += "\tto " + std::to_string(pw_constructive_max_length) + " chars)\n";
+	s += "  --dump-phonemes\n";
+	s += "\tPrint the phoneme automaton for the given options as a table and exit\n";
+	s += "  --entropy\n";
+	s += "\tPrint the entropy (exact w/ -s, else bounds) and number of the passwords and exit\n";
+	s += "  --unique\n";
+	s += "\tNever print the same password twice; redraws are counted on stderr\n";
+	s += "  --stream\n";
+	s += "\tPrint passwords until the output is closed (as num_pw == 0)\n";
+	s += "  --serve=<socket>\n";
+	s += "\tHand out passwords for these (or per request) options on a Unix domain socket;\n";
+	s += "\tnot w/ --seed or -H\n";
+	s += "  --stats[=json]\n";
+	s += "\tPrint the run's counters (retries, rng draws, time per phase) to stderr\n";
+	s += "  --output=<file>\n";
+	s += "\tWrite the passwords to file instead of stdout\n";
+	s += "  --threads=<n>\n";
+	s += "\tGenerate on n threads (0 => one per core; at most " + std::to_string(pw_max_threads) 
+		+ ")\n";
+	s += "  --seed=<n>\n";
+	s += "\tSeed the generator w/ a decimal number (64 bits) or 0x<up to 64 hex digits> (256\n";
+	s += "\tbits); the output for a given seed does not depend on --threads\n";
+	s += "  --index=<n>\n";
+	s += "\tWith --seed or -H, start at password n (from 0) of the sequence\n";
+	
+	return s;
+}
+
@@ -0,0 +1,180 @@
+// pw_batch.cpp -- generate passwords in bulk into a single arena
+// Copyright (C) 2018, 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <random>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <exception>
+#include "pwgen.h"
+
+
+std::size_t pw_batch_t::size() const {
+	return offsets.size()-1;
+}
+std::string_view pw_batch_t::operator[](std::size_t i) const {
+	return std::string_view(chars.data()+offsets[i],offsets[i+1]-offsets[i]);
+}
+void pw_batch_t::clear() {
+	chars.clear();
+	offsets.resize(1);
+	offsets[0] = 0;
+}
+
+void pw_wipe(void *p, std::size_t n) {
+	volatile char *v = static_cast<volatile char*>(p);
+	for (std::size_t i=0; i<n; ++i) {
+		v[i] = 0;
+	}
+}
+
+double seconds_since(std::chrono::steady_clock::time_point t0) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// plan.opts is opts as the generators take them:  too short for phonemes => pw_rand(), and 
+// the classes a short phoneme passwd can't hold aren't required.  
+pw_plan_t make_pw_plan(const pw_opts_t& opts) {
+	if (opts.pw_length <= 0) {
+		throw pw_error("Invalid password length");
+	}
+	pw_plan_t plan {};
+	plan.opts = opts;
+	if (plan.opts.pw_length < 5) {
+		plan.opts.random = true;
+	}
+	if (!plan.opts.random) {
+		if (plan.opts.pw_length <= 2) { plan.opts.uppers = false; }  // pwgen_flags &= ~PW_UPPERS;
+		if (plan.opts.pw_length <= 1) { plan.opts.digits = false; }  // pwgen_flags &= ~PW_DIGITS;
+		// Not sure why not allowed to have uppers in 2-char pw's, or digits in 1-char pw's.
+		// Do i not understand this correctly?
+		plan.phonemes = make_phoneme_tables(plan.opts);
+	} else {
+		plan.charset = make_charset_plan(plan.opts);
+	}
+	return plan;
+}
+
+void pw_generate(const pw_plan_t& plan, pw_rng_t& re, char *dest, pw_stats_t *stats) {
+	if (!plan.opts.random) {
+		pw_phonemes(plan.opts,plan.phonemes,re,dest,stats);
+	} else {
+		pw_rand(plan.charset,re,dest,stats);
+	}
+}
+
+// Both generators emit exactly opts.pw_length chars, so the arena is sized once up front 
+// and passwd i is written in place at i*pw_length.  
+void resize_batch(const pw_plan_t& plan, std::size_t n, pw_batch_t& batch) {
+	const std::size_t len = plan.opts.pw_length;
+	batch.chars.resize(n*len);
+	batch.offsets.resize(n+1);
+	for (std::size_t i=0; i<=n; ++i) {
+		batch.offsets[i] = i*len;
+	}
+}
+
+void generate_batch(const pw_plan_t& plan, std::size_t n, pw_batch_t& batch, pw_rng_t& re, 
+					pw_stats_t *stats) {
+	const auto t0 = std::chrono::steady_clock::now();
+	const auto d0 = re.draws();
+	resize_batch(plan,n,batch);
+	for (std::size_t i=0; i<n; ++i) {
+		pw_generate(plan,re,batch.chars.data()+batch.offsets[i],stats);
+	}
+	if (stats) {
+		stats->npw += n;
+		stats->ndraws += re.draws() - d0;
+		stats->t_generate += seconds_since(t0);
+	}
+}
+
+void generate_batch(const pw_opts_t& opts, std::size_t n, pw_batch_t& batch, pw_rng_t& re, 
+					pw_stats_t *stats) {
+	generate_batch(make_pw_plan(opts),n,batch,re,stats);
+}
+
+// The arena is sized once, then each worker writes its own range of chunks in place:  the 
+// per-thread buffers are disjoint slices of the arena, so merging them in order is free.  
+//
+// W/ a unique set, each passwd is redrawn from the same engine until it is new.  Which of 
+// two equal passwds of a batch gets redrawn then depends on the timing of the threads, so 
+// the output of a seeded --unique run is only reproducible w/ --threads=1.  If a passwd 
+// can't be made new in pw_unique_max_tries, the keyspace is taken to be exhausted:  the 
+// workers stop and the pw_error is thrown here, after the join.  
+//
+void generate_batch(const pw_plan_t& plan, std::size_t n, pw_batch_t& batch, 
+					const pw_streams_t& streams, pw_stats_t *stats, pw_unique_set_t *unique) {
+	const auto t0 = std::chrono::steady_clock::now();
+	resize_batch(plan,n,batch);
+
+	const std::size_t nchunks = (n + pw_chunk_size - 1)/pw_chunk_size;
+	const std::size_t nthreads = std::clamp<std::size_t>(streams.nthreads,1,std::max<std::size_t>(nchunks,1));
+	// Each thread counts into its own pw_stats_t; they are summed after the join
+	std::vector<pw_stats_t> tstats(stats ? nthreads : 0);
+	std::vector<std::exception_ptr> errors(nthreads);
+	std::atomic<bool> failed {false};
+	auto work = [&plan,&batch,&streams,&tstats,&errors,&failed,unique,n,nchunks,nthreads](std::size_t t) -> void {
+		pw_stats_t *st = tstats.size() > 0 ? &tstats[t] : nullptr;
+		for (std::size_t k=(t*nchunks)/nthreads; k<((t+1)*nchunks)/nthreads && !failed; ++k) {
+			const std::uint64_t stream = streams.first/pw_chunk_size + k;
+			auto chunk = [&](pw_rng_t& re) -> void {
+				for (std::size_t i=k*pw_chunk_size; i<std::min(n,(k+1)*pw_chunk_size); ++i) {
+					if (streams.seekable) { re.seek(streams.first+i); }
+					char *dest = batch.chars.data()+batch.offsets[i];
+					pw_generate(plan,re,dest,st);
+					if (!unique) { continue; }
+					for (int tries=1; !unique->insert(std::string_view(dest,plan.opts.pw_length)); ++tries) {
+						if (tries == pw_unique_max_tries) {
+							throw pw_error("--unique:  no new password in " + std::to_string(tries) 
+								+ " tries; the keyspace is exhausted");
+						}
+						if (st) { ++st->nduplicates; }
+						pw_generate(plan,re,dest,st);
+					}
+				}
+				if (st) { st->ndraws += re.draws(); }
+			};
+			try {
+				if (streams.sha1) {
+					sha1_engine re(streams.digest,stream);
+					chunk(re);
+				} else {
+					chacha20_engine re(streams.key,stream);
+					chunk(re);
+				}
+			} catch (...) {
+				errors[t] = std::current_exception();
+				failed = true;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers {};
+	for (std::size_t t=1; t<nthreads; ++t) {
+		workers.emplace_back(work,t);
+	}
+	work(0);
+	for (auto& w : workers) {
+		w.join();
+	}
+	for (const auto& e : errors) {
+		if (e) { std::rethrow_exception(e); }
+	}
+	if (stats) {
+		for (const auto& st : tstats) {
+			*stats += st;
+		}
+		stats->npw += n;
+		stats->t_generate += seconds_since(t0);
+	}
+}
+
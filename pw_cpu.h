@@ -0,0 +1,80 @@
+#pragma once
+// pw_cpu.h --- runtime cpu feature detection for the SIMD code paths
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+// The SIMD kernels are compiled for their instruction set via PW_TARGET_* (gcc, clang)
+// regardless of the flags of the rest of the build, and are only called if the cpu_has_*()
+// check passes at runtime; the scalar code is always the fallback.
+//
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PW_HAVE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#else
+#define PW_HAVE_X86 0
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PW_TARGET_AVX2 __attribute__((target("avx2")))
+#define PW_TARGET_SHA __attribute__((target("sha,sse4.1")))
+#else
+#define PW_TARGET_AVX2
+#define PW_TARGET_SHA
+#endif
+
+inline bool cpu_has_avx2() {
+#if PW_HAVE_X86 && (defined(__GNUC__) || defined(__clang__))
+	return __builtin_cpu_supports("avx2");
+#elif PW_HAVE_X86 && defined(_MSC_VER)
+	int r[4] {};
+	__cpuid(r,0);
+	if (r[0] < 7) { return false; }
+	__cpuid(r,1);
+	bool osxsave = (r[2] & (1<<27));
+	bool avx = (r[2] & (1<<28));
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) { return false; }
+	__cpuidex(r,7,0);
+	return (r[1] & (1<<5));
+#else
+	return false;
+#endif
+}
+
+// The SHA extensions (SHA-NI); the cpus that have them all have SSE4.1
+inline bool cpu_has_sha() {
+#if PW_HAVE_X86 && (defined(__GNUC__) || defined(__clang__))
+	unsigned int a {0}, b {0}, c {0}, d {0};
+	if (!__get_cpuid_count(7,0,&a,&b,&c,&d)) { return false; }
+	return (b & (1u<<29)) && __builtin_cpu_supports("sse4.1");
+#elif PW_HAVE_X86 && defined(_MSC_VER)
+	int r[4] {};
+	__cpuid(r,0);
+	if (r[0] < 7) { return false; }
+	__cpuidex(r,7,0);
+	return (r[1] & (1<<29));
+#else
+	return false;
+#endif
+}
+
+inline int ctz32(std::uint32_t x) {  // x != 0
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz(x);
+#elif defined(_MSC_VER)
+	unsigned long i {0};
+	_BitScanForward(&i,x);
+	return static_cast<int>(i);
+#else
+	int i {0};
+	while (!(x & 1)) { x >>= 1; ++i; }
+	return i;
+#endif
+}
+
@@ -0,0 +1,641 @@
+// pw_entropy.cpp -- entropy and number of the passwds of an option set
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <cstdio>  // std::snprintf()
+#include "pwgen.h"
+
+
+//
+// pw_rand() is uniform over the length-L strings over chars that include every required
+// class (the retry loop by rejection, the constructive mode by construction), so both
+// entropies are log2 of their number.  By inclusion-exclusion over the sets S of required
+// classes, that is sum_S (-1)^|S| (N - |S's chars|)^L, which is computed as
+// L*log2(N) + log2(sum_S (-1)^|S| (1 - |S's chars|/N)^L) so that nothing overflows.
+//
+pw_entropy_t charset_entropy(const charset_plan_t& plan) {
+	const double n = static_cast<double>(plan.chars.size());
+	std::array<int,8> nchars {};  // Of the classes in each cflag set
+	for (const auto& c : plan.chars) {
+		const auto cf = plan.cls[static_cast<unsigned char>(c)];
+		for (int m=0; m<8; ++m) {
+			nchars[m] += (cf & m) != 0;
+		}
+	}
+	double p {0.0};
+	for (int m=0; m<8; ++m) {
+		if ((m & plan.required) != m || nchars[m] == n) { continue; }  // Those terms are 0
+		const double sign = (std::bitset<3>(m).count() % 2) ? -1.0 : 1.0;
+		p += sign*std::exp2(plan.pw_length*std::log2(1.0 - nchars[m]/n));
+	}
+	pw_entropy_t h {};
+	h.shannon = plan.pw_length*std::log2(n) + std::log2(p);
+	h.min = h.shannon;
+	h.shannon_lower = h.shannon;
+	h.min_lower = h.min;
+	h.log2_npasswds = h.shannon;
+	return h;
+}
+
+//
+// The walks a char at a time:  a node is either a step boundary (state s, features m still
+// missing) or the rest of a step, i.e. a symbol still to pick and/or element chars still to
+// emit, then the boundary it leads to.  Two steps w/ the same rest share its node, so the
+// nodes are few.  Each edge emits a char; the edges of a walk's steps multiply to its
+// probability.  Every digit leaves every node for the same nodes w/ the same weights, and
+// so does every symbol, so an edge stands for a whole class:  n chars, each of weight w.
+//
+// The weights are those of the automaton w/o the conditioning, unit/total[s] per 
+// sub-outcome, so they don't depend on the chars left:  the conditioned probability of a 
+// walk, the product of its steps' unit*c_child/(total[s]*c_parent), telescopes to the 
+// product of their unit/total[s] over the ncomplete[] of the start.  A walk that can't 
+// finish just isn't at an accepting node (a boundary w/ nothing missing) at the end.  
+//
+namespace {
+
+struct pw_cedge_t {
+	char c;  // Or pw_cdigit, pw_csymbol
+	std::uint32_t next;  // Index in pw_char_nfa_t::nodes
+	double w;
+	double n;  // Chars
+};
+constexpr char pw_cdigit {'\x01'};
+constexpr char pw_csymbol {'\x02'};
+
+constexpr std::uint32_t pw_cnode(int s, int m, bool sym, const char *text, int ntext) {
+	return static_cast<std::uint32_t>(s) | (static_cast<std::uint32_t>(m) << 2) 
+		| (std::uint32_t {sym} << 5) | (static_cast<std::uint32_t>(ntext) << 6) 
+		| (ntext > 0 ? static_cast<std::uint32_t>(static_cast<unsigned char>(text[0])) << 8 : 0) 
+		| (ntext > 1 ? static_cast<std::uint32_t>(static_cast<unsigned char>(text[1])) << 16 : 0);
+}
+constexpr bool pw_caccepts(std::uint32_t node) { return (node & 0xfc) == 0; }
+
+// Whether the walks at two nodes can still spell the same chars:  the chars a node must 
+// emit next (a symbol, then what is left of its element) of one start those of the other
+constexpr bool pw_cagree(std::uint32_t a, std::uint32_t b) {
+	const int na = ((a >> 5) & 1) + ((a >> 6) & 3);
+	const int nb = ((b >> 5) & 1) + ((b >> 6) & 3);
+	auto forced = [](std::uint32_t node, int i) -> int {  // Char i, or -1 for a symbol
+		if ((node >> 5) & 1) {
+			if (i == 0) { return -1; }
+			--i;
+		}
+		return static_cast<int>((node >> (8 + 8*i)) & 0xff);
+	};
+	for (int i=0; i<na && i<nb; ++i) {
+		if (forced(a,i) != forced(b,i)) { return false; }
+	}
+	return true;
+}
+
+// The nodes reachable from the start (nodes[0]), each w/ its edges sorted by char
+struct pw_char_nfa_t {
+	std::vector<std::uint32_t> nodes {};
+	std::vector<std::vector<pw_cedge_t>> out {};
+
+	explicit pw_char_nfa_t(const phoneme_tables_t& tbl) {
+		std::unordered_map<std::uint32_t,std::uint32_t> index {};
+		auto add = [this,&index](std::uint32_t node) -> std::uint32_t {
+			const auto [it, added] = index.emplace(node,static_cast<std::uint32_t>(nodes.size()));
+			if (added) { nodes.push_back(node); }
+			return it->second;
+		};
+		add(pw_cnode(st_start,tbl.required,false,nullptr,0));
+		for (std::size_t i=0; i<nodes.size(); ++i) {
+			auto es = edges(tbl,nodes[i]);
+			for (auto& x : es) {
+				x.next = add(x.next);
+			}
+			std::sort(es.begin(),es.end(),[](const pw_cedge_t& a, const pw_cedge_t& b) -> bool { 
+				return a.c < b.c || (a.c == b.c && a.next < b.next); });
+			out.push_back(std::move(es));
+		}
+	}
+
+	// The edges out of node, to nodes (not yet indices)
+	static std::vector<pw_cedge_t> edges(const phoneme_tables_t& tbl, std::uint32_t node) {
+		std::vector<pw_cedge_t> es {};
+		const int s = node & 3;
+		const int m = (node >> 2) & 7;
+		const bool sym = (node >> 5) & 1;
+		const int ntext = (node >> 6) & 3;
+		const char text[3] {static_cast<char>(node >> 8), static_cast<char>(node >> 16), '\0'};
+		const double ndigits = static_cast<double>(tbl.digits.size());
+		const double nsymbols = static_cast<double>(tbl.symbols.size());
+		if (sym) {
+			es.push_back({pw_csymbol, pw_cnode(s,m,false,text,ntext), 1.0/nsymbols, nsymbols});
+		} else if (ntext > 0) {
+			es.push_back({text[0], pw_cnode(s,m,false,text+1,ntext-1), 1.0, 1.0});
+		} else {
+			for (const auto& t : tbl.trans[s]) {
+				const bool d = (t.features & cflag::digit);
+				const bool y = (t.features & cflag::symbol);
+				const int m2 = m & ~t.features;
+				const double q = static_cast<double>(t.unit)/tbl.total[s];
+				if (d) {
+					es.push_back({pw_cdigit, pw_cnode(t.next,m2,y,t.text.str,t.text.len), 
+						q*(y ? nsymbols : 1.0), ndigits});
+				} else if (y) {
+					es.push_back({pw_csymbol, pw_cnode(t.next,m2,false,t.text.str,t.text.len), 
+						q, nsymbols});
+				} else {
+					es.push_back({t.text.str[0], pw_cnode(t.next,m2,false,t.text.str+1,t.text.len-1), 
+						q, 1.0});
+				}
+			}
+		}
+		return es;
+	}
+};
+
+// Scales v by a power of 2 (so exactly) once its largest entry leaves [2^-512, 2^512], and 
+// keeps the log2 of the scale
+void pw_rescale(std::vector<double>& v, int& log2_scale) {
+	const double top = *std::max_element(v.begin(),v.end());
+	int e {0};
+	std::frexp(top,&e);
+	if (top == 0.0 || (e > -512 && e < 512)) {
+		return;
+	}
+	for (auto& x : v) {
+		x = std::ldexp(x,-e);
+	}
+	log2_scale += e;
+}
+
+}
+
+//
+// What the walks' entropies can't see:  the passwds themselves, each the sum of the walks
+// that spell it.  Two DPs over the prefixes, a char at a time:
+// -> By the set of nodes a prefix can be at (the subset construction), so each prefix is
+//    counted once:  the number of passwds.  Along, for each node of a set, the most 
+//    probability any one prefix of the set has there; their sum over the sets at the end 
+//    bounds every passwd's probability from above, so -log2 of it is a lower bound on the 
+//    min-entropy.
+// -> By pairs of nodes that the walks of one prefix are at, w/ the sum over prefixes of the
+//    products of their probabilities:  at the end, sum_passwd p^2, the collision entropy
+//    H2 = -log2(sum p^2), which is a lower bound on the Shannon entropy (and H2/2 one on
+//    the min-entropy).  Along, the same sum w/ the second walk counted rather than
+//    weighted:  E[k], the mean number k of walks that spell the passwd of a walk.  Given
+//    its passwd, a walk is one of k, so H(walk) - H(passwd) <= E[log2 k] <= log2 E[k].
+// The weights don't depend on the position, so the sets, the pairs and the moves between 
+// them are found once, whatever the length:  about a hundred sets, and under a thousand 
+// pairs, as a pair whose walks must emit different chars next (the rest of "ch" and of 
+// "ck") is dropped.  Each char is then a pass over flat arrays, rescaled as they grow or 
+// shrink.  
+//
+void phoneme_strings(const phoneme_tables_t& tbl, pw_entropy_t& e) {
+	const pw_char_nfa_t nfa(tbl);
+	const int len = tbl.pw_length;
+	const double log2_c = std::log2(tbl.ncomplete[(len*3 + st_start)*8 + tbl.required]);
+
+	// The sets, each a sorted list of nodes, and their moves by char:  n chars to set to, 
+	// which take the probability at node i of the set times w to node j of set to
+	struct dcontrib_t {
+		std::uint32_t i, j;
+		double w;
+	};
+	struct dmove_t {
+		std::uint32_t to;
+		double n;
+		std::size_t first, last;  // In contribs
+	};
+	std::vector<std::vector<std::uint32_t>> sets {{0}};
+	std::vector<std::size_t> set_moves {0};  // Set k's moves are [set_moves[k], set_moves[k+1])
+	std::vector<dmove_t> moves {};
+	std::vector<dcontrib_t> contribs {};
+	std::map<std::vector<std::uint32_t>,std::uint32_t> set_index {{{0}, 0}};
+	for (std::size_t k=0; k<sets.size(); ++k) {
+		std::map<char,std::vector<std::pair<std::uint32_t,const pw_cedge_t*>>> by_char {};
+		for (std::uint32_t i=0; i<sets[k].size(); ++i) {
+			for (const auto& x : nfa.out[sets[k][i]]) {
+				by_char[x.c].push_back({i, &x});
+			}
+		}
+		for (const auto& [c, xs] : by_char) {
+			std::vector<std::uint32_t> to {};
+			for (const auto& [i, x] : xs) { to.push_back(x->next); }
+			std::sort(to.begin(),to.end());
+			to.erase(std::unique(to.begin(),to.end()),to.end());
+			const auto [it, added] = set_index.emplace(to,static_cast<std::uint32_t>(sets.size()));
+			if (added) { sets.push_back(to); }
+			moves.push_back({it->second, xs.front().second->n, contribs.size(), 0});
+			for (const auto& [i, x] : xs) {
+				const auto j = std::lower_bound(to.begin(),to.end(),x->next) - to.begin();
+				contribs.push_back({i, static_cast<std::uint32_t>(j), x->w});
+			}
+			moves.back().last = contribs.size();
+		}
+		set_moves.push_back(moves.size());
+	}
+	std::vector<std::size_t> set_first {0};  // Of each set's nodes in pmax
+	for (const auto& s : sets) { set_first.push_back(set_first.back() + s.size()); }
+
+	// The pairs, and their moves:  to, times w_a*w_b*n (the collision sum) and w_a*n (E[k])
+	struct pmove_t {
+		std::uint32_t to;
+		double p2, k;
+	};
+	std::vector<std::uint64_t> pairs {0};
+	std::vector<std::size_t> pair_moves {0};
+	std::vector<pmove_t> pmoves {};
+	std::unordered_map<std::uint64_t,std::uint32_t> pair_index {{0, 0}};
+	for (std::size_t q=0; q<pairs.size(); ++q) {
+		const auto& ea = nfa.out[pairs[q] >> 32];
+		const auto& eb = nfa.out[pairs[q] & 0xffffffff];
+		std::size_t j0 {0};
+		for (const auto& x : ea) {
+			while (j0 < eb.size() && eb[j0].c < x.c) { ++j0; }
+			for (std::size_t j=j0; j<eb.size() && eb[j].c == x.c; ++j) {
+				if (!pw_cagree(nfa.nodes[x.next],nfa.nodes[eb[j].next])) { continue; }
+				const std::uint64_t ab = (std::uint64_t {x.next} << 32) | eb[j].next;
+				const auto [it, added] = pair_index.emplace(ab,static_cast<std::uint32_t>(pairs.size()));
+				if (added) { pairs.push_back(ab); }
+				pmoves.push_back({it->second, x.n*x.w*eb[j].w, x.n*x.w});
+			}
+		}
+		pair_moves.push_back(pmoves.size());
+	}
+
+	std::vector<double> count(sets.size(),0.0);
+	std::vector<double> pmax(set_first.back(),0.0);
+	std::vector<double> p2(pairs.size(),0.0);
+	std::vector<double> k(pairs.size(),0.0);
+	count[0] = pmax[0] = p2[0] = k[0] = 1.0;
+	int log2_count {0}, log2_pmax {0}, log2_p2 {0}, log2_k {0};  // Their scales
+	std::vector<double> acc {};
+	for (int pos=0; pos<len; ++pos) {
+		std::vector<double> next_count(count.size(),0.0);
+		std::vector<double> next_pmax(pmax.size(),0.0);
+		for (std::size_t s=0; s<sets.size(); ++s) {
+			if (count[s] == 0.0) { continue; }
+			for (std::size_t mv=set_moves[s]; mv<set_moves[s+1]; ++mv) {
+				const auto& v = moves[mv];
+				next_count[v.to] += count[s]*v.n;
+				acc.assign(sets[v.to].size(),0.0);
+				for (std::size_t x=v.first; x<v.last; ++x) {
+					acc[contribs[x].j] += pmax[set_first[s] + contribs[x].i]*contribs[x].w;
+				}
+				for (std::size_t j=0; j<acc.size(); ++j) {
+					auto& p = next_pmax[set_first[v.to] + j];
+					p = std::max(p,acc[j]);
+				}
+			}
+		}
+		count = std::move(next_count);
+		pmax = std::move(next_pmax);
+		pw_rescale(count,log2_count);
+		pw_rescale(pmax,log2_pmax);
+
+		std::vector<double> next_p2(p2.size(),0.0);
+		std::vector<double> next_k(k.size(),0.0);
+		for (std::size_t q=0; q<pairs.size(); ++q) {
+			if (p2[q] == 0.0) { continue; }
+			for (std::size_t mv=pair_moves[q]; mv<pair_moves[q+1]; ++mv) {
+				next_p2[pmoves[mv].to] += p2[q]*pmoves[mv].p2;
+				next_k[pmoves[mv].to] += k[q]*pmoves[mv].k;
+			}
+		}
+		p2 = std::move(next_p2);
+		k = std::move(next_k);
+		pw_rescale(p2,log2_p2);
+		pw_rescale(k,log2_k);
+	}
+
+	double npasswds {0.0};
+	double pmax_end {0.0};
+	for (std::size_t s=0; s<sets.size(); ++s) {
+		double p {0.0};
+		for (std::size_t i=0; i<sets[s].size(); ++i) {
+			if (pw_caccepts(nfa.nodes[sets[s][i]])) { p += pmax[set_first[s] + i]; }
+		}
+		if (p > 0.0) {
+			npasswds += count[s];
+			pmax_end = std::max(pmax_end,p);
+		}
+	}
+	double collision {0.0};
+	double nwalks {0.0};
+	for (std::size_t q=0; q<pairs.size(); ++q) {
+		if (pw_caccepts(nfa.nodes[pairs[q] >> 32]) && pw_caccepts(nfa.nodes[pairs[q] & 0xffffffff])) {
+			collision += p2[q];
+			nwalks += k[q];
+		}
+	}
+	const double h2 = 2*log2_c - std::log2(collision) - log2_p2;
+	const double log2_k_mean = std::log2(nwalks) + log2_k - log2_c;
+	e.log2_npasswds = std::log2(npasswds) + log2_count;
+	e.shannon_lower = std::min(std::max(h2,e.shannon - log2_k_mean),e.shannon);
+	e.min_lower = std::min(std::max(log2_c - std::log2(pmax_end) - log2_pmax,h2/2),e.min);
+}
+
+//
+// pw_phonemes() is the walk of the automaton conditioned on emitting exactly pw_length
+// chars w/ every required feature:  from (r chars left, state s, features m missing), a
+// sub-outcome of transition t in group g has probability unit_t*c_g/Z, where c_g is the
+// ncomplete[] of where g leads and Z = sum_g weight_g*c_g.  So, w/ A_g = weight_g and
+// B_g = sum over t in g of unit_t*nsub_t*log2(unit_t),
+//   H(r,s,m) = sum_g (c_g/Z)*(A_g*(log2(Z) - log2(c_g)) - B_g + A_g*H(r - len_g, next_g, m'))
+//   M(r,s,m) = max_g log2(max unit_t*c_g/Z) + M(r - len_g, next_g, m')
+// over the (r, s, m) from r = 0 up; the min-entropy is -M.  These are the entropies of the
+// walk, and two walks can spell the same passwd ("a" then "e", or "ae"), so they are
+// upper bounds on the entropies of the passwds; phoneme_strings() adds the lower bounds.
+//
+pw_entropy_t phoneme_entropy(const phoneme_tables_t& tbl) {
+	struct gstat_t {
+		double a {0.0};
+		double b {0.0};
+		double log2_maxunit {-HUGE_VAL};
+	};
+	std::array<std::vector<gstat_t>,3> gs {};
+	for (int s=0; s<3; ++s) {
+		const auto& groups = tbl.groups[s];
+		gs[s].resize(groups.size());
+		std::size_t j {0};
+		for (const auto& t : tbl.trans[s]) {
+			while (t.first >= groups[j].first + groups[j].weight) { ++j; }
+			const std::uint32_t nsub = ((t.features & cflag::digit) ? tbl.digits.size() : 1)
+				* ((t.features & cflag::symbol) ? tbl.symbols.size() : 1);
+			const double w = static_cast<double>(t.unit)*nsub;
+			gs[s][j].a += w;
+			gs[s][j].b += w*std::log2(t.unit);
+			gs[s][j].log2_maxunit = std::max(gs[s][j].log2_maxunit,std::log2(t.unit));
+		}
+	}
+
+	const int len = tbl.pw_length;
+	std::vector<double> h(8*3*(len+1),0.0);
+	std::vector<double> mx(8*3*(len+1),0.0);
+	auto idx = [](int r, int s, int m) -> std::size_t { return (r*3 + s)*8 + m; };
+	for (int r=1; r<=len; ++r) {
+		for (int s=0; s<3; ++s) {
+			const auto& groups = tbl.groups[s];
+			for (int m=0; m<8; ++m) {
+				double z {0.0};
+				for (const auto& g : groups) {
+					if (g.len > r) { continue; }
+					z += g.weight*tbl.ncomplete[idx(r-g.len,g.next,m & ~g.features)];
+				}
+				if (z == 0.0) { continue; }  // Unreachable
+				const double log2_z = std::log2(z);
+				double hs {0.0};
+				double ms {-HUGE_VAL};
+				for (std::size_t j=0; j<groups.size(); ++j) {
+					const auto& g = groups[j];
+					if (g.len > r) { continue; }
+					const auto child = idx(r-g.len,g.next,m & ~g.features);
+					const double c = tbl.ncomplete[child];
+					if (c == 0.0) { continue; }
+					const double log2_c = std::log2(c);
+					hs += (c/z)*(gs[s][j].a*(log2_z - log2_c + h[child]) - gs[s][j].b);
+					ms = std::max(ms,gs[s][j].log2_maxunit + log2_c - log2_z + mx[child]);
+				}
+				h[idx(r,s,m)] = hs;
+				mx[idx(r,s,m)] = ms;
+			}
+		}
+	}
+
+	pw_entropy_t e {};
+	e.shannon = h[idx(len,st_start,tbl.required)];
+	e.min = -mx[idx(len,st_start,tbl.required)];
+	e.exact = false;
+	phoneme_strings(tbl,e);
+	return e;
+}
+
+pw_entropy_t pw_entropy(const pw_plan_t& plan) {
+	return plan.opts.random ? charset_entropy(plan.charset) : phoneme_entropy(plan.phonemes);
+}
+
+double pw_npasswds(const pw_entropy_t& e) {
+	return std::round(std::exp2(std::min(e.log2_npasswds,40.0)));
+}
+
+std::string format_entropy(const pw_entropy_t& e) {
+	std::array<char,256> buf {};
+	std::array<char,64> count {};
+	if (e.log2_npasswds < 40.0) {
+		std::snprintf(count.data(),count.size(),"%.0f (2^%.4f)",pw_npasswds(e),e.log2_npasswds);
+	} else {
+		std::snprintf(count.data(),count.size(),"2^%.4f",e.log2_npasswds);
+	}
+	if (e.exact) {
+		std::snprintf(buf.data(),buf.size(),
+			"shannon entropy      %.4f bits\n"
+			"min-entropy          %.4f bits\n"
+			"passwords            %s\n",
+			e.shannon, e.min, count.data());
+		return buf.data();
+	}
+	std::snprintf(buf.data(),buf.size(),
+		"shannon entropy      %.4f to %.4f bits\n"
+		"min-entropy          %.4f to %.4f bits\n"
+		"passwords            %s\n",
+		e.shannon_lower, e.shannon, e.min_lower, e.min, count.data());
+	std::string s {buf.data()};
+	s += "(the upper bounds count two ways of spelling the same password apart; the lower\n"
+		" ones allow for every way, and bound the likeliest password)\n";
+	return s;
+}
+
+
+#if defined(TEST)
+
+#include <map>
+#include <chrono>
+
+//
+// Brute force on small option sets:
+// 1) pw_rand:  the number of valid strings, counted one by one.
+// 2) pw_phonemes:  every walk of the conditioned automaton, w/ its probability, enumerated
+//    depth first.  The walks' probabilities sum to 1, their entropies match the DP, the
+//    passwds they spell (several walks may spell one) number exactly npasswds, and the
+//    passwds' entropies are within the bounds.
+// 3) The alias tables:  every draw of each group's table, one by one, lands on a transition 
+//    of the group and a sub-outcome of it, and each sub-outcome of t gets exactly t.span.  
+// 4) Long passwds:  --entropy takes milliseconds, and the bounds and the number (far past 
+//    2^1024) are finite and consistent.  
+//
+struct walk_sums_t {
+	double psum {0.0};
+	double h {0.0};
+	double pmax {0.0};
+	std::map<std::string,double> passwds {};
+};
+
+void enumerate_walks(const phoneme_tables_t& tbl, int r, int s, int m, const std::string& prefix,
+						double p, walk_sums_t& sums) {
+	if (r == 0) {
+		sums.psum += p;
+		sums.h -= p*std::log2(p);
+		sums.pmax = std::max(sums.pmax,p);
+		sums.passwds[prefix] += p;
+		return;
+	}
+	auto c = [&tbl](int r, int s, int m) -> double { return tbl.ncomplete[(r*3 + s)*8 + m]; };
+	double z {0.0};
+	for (const auto& g : tbl.groups[s]) {
+		if (g.len <= r) { z += g.weight*c(r-g.len,g.next,m & ~g.features); }
+	}
+	for (const auto& t : tbl.trans[s]) {
+		const int len = t.text.len + ((t.features & cflag::digit) != 0) + ((t.features & cflag::symbol) != 0);
+		if (len > r || c(r-len,t.next,m & ~t.features) == 0.0) { continue; }
+		const double q = t.unit*c(r-len,t.next,m & ~t.features)/z;
+		const std::string ds = (t.features & cflag::digit) ? tbl.digits : std::string(1,'\0');
+		const std::string ys = (t.features & cflag::symbol) ? tbl.symbols : std::string(1,'\0');
+		for (const auto& d : ds) {
+			for (const auto& y : ys) {
+				std::string step {};
+				if (d) { step += d; }
+				if (y) { step += y; }
+				step.append(t.text.str,t.text.len);
+				enumerate_walks(tbl,r-len,t.next,m & ~t.features,prefix+step,p*q,sums);
+			}
+		}
+	}
+}
+
+int main() {
+	int nfail {0};
+	printf( "\n Entropy vs brute force:\n\n" );
+
+	// 1) {a,b,1,C,D}:  304 4-char passwds w/ a digit and an upper; any 25 2-char ones
+	pw_opts_t opts {};
+	opts.random = true;
+	opts.remove_chars = "cdefghijklmnopqrstuvwxyz023456789ABEFGHIJKLMNOPQRSTUVWXYZ";
+	for (int len : {2, 4, 6}) {
+		opts.pw_length = len;
+		const auto plan = make_pw_plan(opts);
+		const auto& chars = plan.charset.chars;
+		std::uint64_t count {0};
+		std::vector<int> digits(len,0);
+		while (true) {
+			std::uint8_t have {0};
+			for (const auto& i : digits) { have |= plan.charset.cls[static_cast<unsigned char>(chars[i])]; }
+			count += (have & plan.charset.required) == plan.charset.required;
+			int k {0};
+			while (k < len && ++digits[k] == static_cast<int>(chars.size())) { digits[k++] = 0; }
+			if (k == len) { break; }
+		}
+		const auto e = pw_entropy(plan);
+		const bool ok = std::abs(e.shannon - std::log2(count)) < 1e-9 && e.min == e.shannon
+			&& pw_npasswds(e) == count;
+		printf( " pw_rand len %d:  %llu passwds, %.6f bits %s\n", len,
+			static_cast<unsigned long long>(count), e.shannon, ok ? "passed." : "failed!" );
+		nfail += ok ? 0 : 1;
+	}
+
+	// 2) Small digit and symbol sets keep the number of walks down
+	struct case_t {
+		const char *name;
+		bool uppers, digits, symbols;
+		int len;
+	};
+	const std::array<case_t,4> cases {{
+		{"-0A", false, false, false, 6},
+		{"", true, true, false, 5},
+		{"-y", true, true, true, 5},
+		{"-0Ay", false, false, true, 6}
+	}};
+	for (const auto& cs : cases) {
+		pw_opts_t po {};
+		po.uppers = cs.uppers;
+		po.digits = cs.digits;
+		po.symbols = cs.symbols;
+		po.pw_length = cs.len;
+		po.remove_chars = "23456789!\"$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+		const auto plan = make_pw_plan(po);
+		walk_sums_t sums {};
+		enumerate_walks(plan.phonemes,cs.len,st_start,plan.phonemes.required,"",1.0,sums);
+		double hp {0.0};
+		double pmax {0.0};
+		for (const auto& [pw, p] : sums.passwds) {
+			hp -= p*std::log2(p);
+			pmax = std::max(pmax,p);
+		}
+		const auto e = pw_entropy(plan);
+		const bool ok = std::abs(sums.psum - 1.0) < 1e-9 && std::abs(e.shannon - sums.h) < 1e-9
+			&& std::abs(e.min + std::log2(sums.pmax)) < 1e-9 && hp <= e.shannon + 1e-9
+			&& -std::log2(pmax) <= e.min + 1e-9 && pw_npasswds(e) == sums.passwds.size()
+			&& e.shannon_lower <= hp + 1e-9 && e.min_lower <= -std::log2(pmax) + 1e-9;
+		printf( " phonemes %-5s len %d:  walks %.4f / %.4f bits, passwds %.4f / %.4f bits "
+			"(>= %.4f / %.4f), %zu %s\n", cs.name, cs.len, sums.h, -std::log2(sums.pmax), hp, 
+			-std::log2(pmax), e.shannon_lower, e.min_lower, sums.passwds.size(),
+			ok ? "passed." : "failed!" );
+		nfail += ok ? 0 : 1;
+	}
+
+	// 3) Also w/ the full digit and symbol sets, where the tables are largest
+	for (const std::string name : {"", "-y", "-By"}) {
+		pw_opts_t po {};
+		po.symbols = (name.find('y') != std::string::npos);
+		po.no_ambiguous = (name.find('B') != std::string::npos);
+		po.pw_length = 8;
+		const auto tbl = make_phoneme_tables(po);
+		bool ok {true};
+		std::uint64_t ndraws {0};
+		for (int st=0; st<3; ++st) {
+			const auto& trans = tbl.trans[st];
+			std::vector<std::vector<std::uint32_t>> count(trans.size());
+			for (const auto& g : tbl.groups[st]) {
+				const std::uint32_t nsub = ((g.features & cflag::digit) ? tbl.digits.size() : 1)
+					* ((g.features & cflag::symbol) ? tbl.symbols.size() : 1);
+				for (std::uint64_t x=0; x<std::uint64_t {g.ntrans}*g.height; ++x) {
+					const auto& c = tbl.alias[st][g.col + x/g.height];
+					const std::uint32_t y = x % g.height;
+					const std::uint16_t t = y < c.cut ? c.own : c.alias;
+					const std::uint32_t sub = (y < c.cut ? c.own_pos + y : c.alias_pos + (y - c.cut))/trans[t].span;
+					if (trans[t].first < g.first || trans[t].first >= g.first + g.weight || sub >= nsub) {
+						ok = false;
+						continue;
+					}
+					count[t].resize(nsub,0);
+					++count[t][sub];
+					++ndraws;
+				}
+			}
+			for (std::size_t t=0; t<trans.size(); ++t) {
+				ok = ok && count[t].size() > 0 && std::all_of(count[t].begin(),count[t].end(),
+					[&trans,t](std::uint32_t n) -> bool { return n == trans[t].span; });
+			}
+		}
+		printf( " alias tables %-4s %llu draws %s\n", name.c_str(),
+			static_cast<unsigned long long>(ndraws), ok ? "passed." : "failed!" );
+		nfail += ok ? 0 : 1;
+	}
+
+	// 4) A generous limit, for unoptimized builds; optimized, these take 5-30 ms
+	for (const auto& [name, len] : {std::pair {"-y", 128}, {"-y", 256}, {"", 300}, {"-s", 300}}) {
+		pw_opts_t po {};
+		po.symbols = (std::string(name).find('y') != std::string::npos);
+		po.random = (std::string(name).find('s') != std::string::npos);
+		po.pw_length = len;
+		const auto t0 = std::chrono::steady_clock::now();
+		const auto e = pw_entropy(make_pw_plan(po));
+		const double t = seconds_since(t0);
+		const bool ok = t < 0.5 && std::isfinite(e.log2_npasswds) && std::isfinite(e.shannon_lower)
+			&& std::isfinite(e.min_lower) && e.min_lower <= e.min && e.min <= e.shannon 
+			&& e.shannon_lower <= e.shannon && e.shannon <= e.log2_npasswds + 1e-9;
+		printf( " %-3s len %d:  %.4f to %.4f bits, 2^%.4f passwds, %.1f ms %s\n", name, len,
+			e.shannon_lower, e.shannon, e.log2_npasswds, 1e3*t, ok ? "passed." : "failed!" );
+		nfail += ok ? 0 : 1;
+	}
+	printf( "\n" );
+
+	return nfail == 0 ? 0 : 1;
+}
+
+#endif
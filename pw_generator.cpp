@@ -0,0 +1,67 @@
+// pw_generator.cpp -- a reusable generator for one option set
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+
+#include <string>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include "pwgen.h"
+
+
+// The chunks of fill_batch() take the streams from streams.first/pw_chunk_size up, so w/o
+// seekable streams next() draws from the last stream of the key, which they never reach
+constexpr std::uint64_t pw_next_stream {~std::uint64_t {0}};
+
+// W/ seekable streams a passwd is a function of (key, stream) alone, on any cpu, so pw_rand() 
+// keeps to the scalar kernel
+pw_generator_t::pw_generator_t(pw_plan_t p, const pw_streams_t& s)
+		: plan(std::move(p)), streams(s) {
+	if (streams.seekable) {
+		plan.charset.simd = false;
+	}
+	if (streams.sha1) {
+		re = std::make_unique<sha1_engine>(streams.digest,streams.first);
+	} else {
+		re = std::make_unique<chacha20_engine>(streams.key,
+			streams.seekable ? streams.first : pw_next_stream);
+	}
+}
+
+pw_generator_t::pw_generator_t(const pw_opts_t& opts)
+		: pw_generator_t(make_pw_plan(opts),pw_streams_t {chacha20_engine::os_key()}) {
+}
+
+void pw_generator_t::next(char *dest) {
+	if (streams.seekable) {
+		re->seek(streams.first++);
+	}
+	pw_generate(plan,*re,dest);
+}
+
+std::string pw_generator_t::next() {
+	std::string pw(plan.opts.pw_length,'\0');
+	next(pw.data());
+	return pw;
+}
+
+// A batch of less than a chunk would spend a whole chunk's engine setup on a few passwds,
+// so w/o seekable streams it comes from next()'s engine instead
+void pw_generator_t::fill_batch(std::size_t n, pw_batch_t& batch, pw_stats_t *stats,
+								pw_unique_set_t *unique) {
+	if (!streams.seekable && !unique && n < pw_chunk_size) {
+		generate_batch(plan,n,batch,*re,stats);
+		return;
+	}
+	generate_batch(plan,n,batch,streams,stats,unique);
+	streams.first += streams.seekable ? n : (n + pw_chunk_size - 1)/pw_chunk_size*pw_chunk_size;
+}
+
+pw_generator_t make_generator(const std::string& options) {
+	pw_opts_t opts {};
+	run_opts_t run {};
+	parse_args(options,opts,run);
+	return pw_generator_t(make_pw_plan(opts),make_streams(run));
+}
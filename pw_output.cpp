@@ -0,0 +1,121 @@
+// pw_output.cpp -- buffered output of generated passwords
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cerrno>
+#include <algorithm>  // std::max()
+#include <csignal>
+#include <fcntl.h>
+#include "pwgen.h"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/ioctl.h>
+#endif
+
+
+int pw_open_output(const std::string& path) {
+#ifdef _WIN32
+	return _open(path.c_str(),_O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,0644);
+#else
+	return open(path.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+#endif
+}
+
+void pw_ignore_sigpipe() {
+#if defined(SIGPIPE)
+	std::signal(SIGPIPE,SIG_IGN);
+#endif
+}
+
+bool pw_is_tty(int fd) {
+#ifdef _WIN32
+	return _isatty(fd);
+#else
+	return isatty(fd);
+#endif
+}
+
+int pw_term_width(int fd) {
+#if defined(TIOCGWINSZ)
+	winsize ws {};
+	if (pw_is_tty(fd) && ioctl(fd,TIOCGWINSZ,&ws) == 0 && ws.ws_col > 0) {
+		return ws.ws_col;
+	}
+#endif
+	return 80;
+}
+
+// Columns are separated by a single ' ', so a row of num_cols passwds is
+// num_cols*(pw_length+1)-1 chars wide.
+int pw_num_cols(int term_width, int pw_length) {
+	return std::max(term_width/(pw_length+1),1);
+}
+
+// Writes all n bytes, retrying on EINTR and short writes
+bool write_all(int fd, const char *p, std::size_t n) {
+	while (n > 0) {
+#ifdef _WIN32
+		auto nw = _write(fd,p,static_cast<unsigned int>(n));
+#else
+		auto nw = write(fd,p,n);
+#endif
+		if (nw < 0) {
+			if (errno == EINTR) { continue; }
+			return false;
+		}
+		p += nw;
+		n -= static_cast<std::size_t>(nw);
+	}
+	return true;
+}
+
+pw_writer_t make_writer(int fd, int num_cols) {
+	pw_writer_t w {};
+	w.fd = fd;
+	w.num_cols = std::max(num_cols,1);
+	w.buf.reserve(pw_writer_t::capacity);
+	return w;
+}
+
+bool flush_writer(pw_writer_t& w) {
+	bool ok = write_all(w.fd,w.buf.data(),w.buf.size());
+	w.buf.clear();
+	return ok;
+}
+
+bool write_batch(pw_writer_t& w, const pw_batch_t& batch) {
+	for (std::size_t i=0; i<batch.size(); ++i) {
+		const auto pw = batch[i];
+		if (w.buf.size() + pw.size() + 1 > pw_writer_t::capacity) {
+			if (!flush_writer(w)) { return false; }
+		}
+		w.buf.insert(w.buf.end(),pw.begin(),pw.end());
+		if (++w.col == w.num_cols) {
+			w.buf.push_back('\n');
+			w.col = 0;
+		} else {
+			w.buf.push_back(' ');
+		}
+	}
+	return true;
+}
+
+// A partial last row ends w/ the ' ' written after its last passwd; replace it w/ '\n'
+bool finish_writer(pw_writer_t& w) {
+	if (w.col != 0) {
+		if (w.buf.size() > 0) {
+			w.buf.back() = '\n';
+		} else {
+			w.buf.push_back('\n');
+		}
+		w.col = 0;
+	}
+	return flush_writer(w);
+}
+
@@ -9,9 +9,11 @@
 #include <cstdlib>  // std::atoi()
 #include <algorithm>
 #include <iterator>  // std::std::back_inserter()
-#include <iostream>  // only for debugging
 #include "pwgen.h"
 #include <array>
+#include <type_traits>
+#include <cstdio>  // std::snprintf()
+#include <numeric>  // std::gcd()
 
 //
 // Everything has a single consonant label or a single vowel label; some items have
@@ -27,64 +29,121 @@
 //
 
 
-std::array<pw_element,40> elements {
-	{{ "a",	eflag::vowel | eflag::first},
-	{ "ae", eflag::vowel | eflag::dipthong | eflag::first},
-	{ "ah",	eflag::vowel | eflag::dipthong | eflag::first},
-	{ "ai", eflag::vowel | eflag::dipthong | eflag::first},
-	{ "b",  eflag::first},
-	{ "c",	eflag::first},
-	{ "ch", eflag::dipthong | eflag::first},
-	{ "d",	eflag::first},
-	{ "e",	eflag::vowel | eflag::first },
-	{ "ee", eflag::vowel | eflag::dipthong | eflag::first},
-	{ "ei",	eflag::vowel | eflag::dipthong | eflag::first},
-	{ "f",	eflag::first},
-	{ "g",	eflag::first},
-	{ "gh", eflag::dipthong},  // NB: !first
-	{ "h",	eflag::first},
-	{ "i",	eflag::vowel | eflag::first},
-	{ "ie", eflag::vowel | eflag::dipthong | eflag::first},
-	{ "j",	eflag::first},
-	{ "k",	eflag::first},
-	{ "l",	eflag::first},
-	{ "m",	eflag::first},
-	{ "n",	eflag::first},
-	{ "ng",	eflag::dipthong},  // NB: !first
-	{ "o",	eflag::vowel | eflag::first},
-	{ "oh",	eflag::vowel | eflag::dipthong | eflag::first},
-	{ "oo",	eflag::vowel | eflag::dipthong | eflag::first},
-	{ "p",	eflag::first},
-	{ "ph",	eflag::dipthong | eflag::first},
-	{ "qu",	eflag::dipthong | eflag::first},
-	{ "r",	eflag::first},
-	{ "s",	eflag::first},
-	{ "sh",	eflag::dipthong | eflag::first},   // NB: !first
-	{ "t",	eflag::first},
-	{ "th",	eflag::dipthong | eflag::first},
-	{ "u",	eflag::vowel | eflag::first},
-	{ "v",	eflag::first},
-	{ "w",	eflag::first},
-	{ "x",	eflag::first},
-	{ "y",	eflag::first},
-	{ "z",	eflag::first}}
+constexpr std::array<pw_element,40> elements {
+	make_element("a",	eflag::vowel | eflag::first),
+	make_element("ae", eflag::vowel | eflag::dipthong | eflag::first),
+	make_element("ah", eflag::vowel | eflag::dipthong | eflag::first),
+	make_element("ai", eflag::vowel | eflag::dipthong | eflag::first),
+	make_element("b",	eflag::first),
+	make_element("c",	eflag::first),
+	make_element("ch", eflag::dipthong | eflag::first),
+	make_element("d",	eflag::first),
+	make_element("e",	eflag::vowel | eflag::first),
+	make_element("ee", eflag::vowel | eflag::dipthong | eflag::first),
+	make_element("ei", eflag::vowel | eflag::dipthong | eflag::first),
+	make_element("f",	eflag::first),
+	make_element("g",	eflag::first),
+	make_element("gh", eflag::dipthong),  // NB: !first
+	make_element("h",	eflag::first),
+	make_element("i",	eflag::vowel | eflag::first),
+	make_element("ie", eflag::vowel | eflag::dipthong | eflag::first),
+	make_element("j",	eflag::first),
+	make_element("k",	eflag::first),
+	make_element("l",	eflag::first),
+	make_element("m",	eflag::first),
+	make_element("n",	eflag::first),
+	make_element("ng", eflag::dipthong),  // NB: !first
+	make_element("o",	eflag::vowel | eflag::first),
+	make_element("oh", eflag::vowel | eflag::dipthong | eflag::first),
+	make_element("oo", eflag::vowel | eflag::dipthong | eflag::first),
+	make_element("p",	eflag::first),
+	make_element("ph", eflag::dipthong | eflag::first),
+	make_element("qu", eflag::dipthong | eflag::first),
+	make_element("r",	eflag::first),
+	make_element("s",	eflag::first),
+	make_element("sh", eflag::dipthong | eflag::first),   // NB: !first
+	make_element("t",	eflag::first),
+	make_element("th", eflag::dipthong | eflag::first),
+	make_element("u",	eflag::vowel | eflag::first),
+	make_element("v",	eflag::first),
+	make_element("w",	eflag::first),
+	make_element("x",	eflag::first),
+	make_element("y",	eflag::first),
+	make_element("z",	eflag::first)
 };
+static_assert(sizeof(elements) == 5*elements.size());
+static_assert(std::is_trivially_copyable_v<pw_element>);
 
-constexpr bool is_consonant(int ef) {
-	return !(ef & eflag::vowel);
-}
-constexpr bool is_vowel(int ef) {
-	return (ef & eflag::vowel);
+//
+// Flag-derived subsets of elements[], as arrays of indices, computed at compile time.  
+// make_phoneme_tables() filters these against the runtime options.  
+//
+template<typename Pred>
+constexpr int count_elements(Pred p) {
+	int n {0};
+	for (const auto& e : elements) {
+		n += p(e.flags);
+	}
+	return n;
 }
-constexpr bool is_dipthong(int ef) {
-	return (ef & eflag::dipthong);
+template<int N, typename Pred>
+constexpr std::array<std::uint8_t,N> select_elements(Pred p) {
+	std::array<std::uint8_t,N> idx {};
+	int j {0};
+	for (std::size_t i=0; i<elements.size(); ++i) {
+		if (p(elements[i].flags)) { idx[j++] = static_cast<std::uint8_t>(i); }
+	}
+	return idx;
 }
-constexpr bool is_vowel_and_dipth(int ef) {
-	return ((ef & eflag::vowel) && (ef & eflag::dipthong));
+constexpr auto vowel_elements = select_elements<count_elements(is_vowel)>(is_vowel);
+constexpr auto single_vowel_elements 
+	= select_elements<count_elements(is_single_vowel)>(is_single_vowel);
+constexpr auto consonant_elements = select_elements<count_elements(is_consonant)>(is_consonant);
+constexpr auto first_consonant_elements 
+	= select_elements<count_elements(is_first_consonant)>(is_first_consonant);
+
+struct element_stats_t {
+	int is_vowel {0};
+	int is_dipth {0};
+	int is_vowel_dipth {0};
+	int is_consonant {0};
+	int is_first {0};
+};
+constexpr element_stats_t element_stats() {
+	element_stats_t counts {};
+	for (const auto& e : elements) {
+		counts.is_vowel += is_vowel(e.flags);
+		counts.is_dipth += is_dipthong(e.flags);
+		counts.is_vowel_dipth += is_vowel_and_dipth(e.flags);
+		counts.is_consonant += is_consonant(e.flags);
+		counts.is_first += may_appear_first(e.flags);
+	}
+	return counts;
 }
-constexpr bool may_appear_first(int ef) {
-	return (ef & eflag::first);
+constexpr bool elements_are_sane() {
+	for (const auto& e : elements) {
+		if (!debug_sanity_check_eflag_conditions(e.flags)) {
+			return false;
+		}
+		if (is_dipthong(e.flags) != (e.len == 2)) {  // dipthong iff 2 letters
+			return false;
+		}
+		if (e.weight == 0) {
+			return false;
+		}
+	}
+	return true;
 }
+constexpr element_stats_t elements_summary = element_stats();
+static_assert(elements_summary.is_vowel == 13);
+static_assert(elements_summary.is_dipth == 15);
+static_assert(elements_summary.is_vowel_dipth == 8);
+static_assert(elements_summary.is_consonant == 27);
+static_assert(elements_summary.is_first == 38);
+static_assert(elements_summary.is_vowel + elements_summary.is_consonant == elements.size());
+static_assert(elements_are_sane());
+static_assert(vowel_elements.size() + consonant_elements.size() == elements.size());
+
 bool is_digit(char c) {
 	auto n = c - '0';
 	return (n >= 0 && n <= 9);
@@ -92,264 +151,380 @@ bool is_digit(char c) {
 	//std::array<char,2> str {c, '\0'};
 	//return std::atoi(&str[0]) >= 0 && std::atoi(&str[0]) <= 9;
 }
-bool debug_sanity_check_eflag_conditions(int ef) {
-	if (is_vowel(ef) && is_consonant(ef)) {
-		return false;
-	}
 
-	if (is_vowel_and_dipth(ef) && is_consonant(ef)) {
-		return false;
-	}
+const std::string pw_digits_all {"0123456789"};
+const std::string pw_symbols_all {"!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~"};
+const std::string pw_ambiguous_all {"B8G6I1l0OQDS5Z2"};
+const std::string pw_vowels_all {"01aeiouyAEIOUY"};
 
-	if (is_vowel_and_dipth(ef) && !is_vowel(ef)) {
-		return false;
+constexpr pw_element to_upper(pw_element e) {
+	for (int i=0; i<e.len; ++i) {
+		if (e.str[i] >= 'a' && e.str[i] <= 'z') { e.str[i] -= ('a'-'A'); }
 	}
-
-	return true;
+	return e;
 }
 
-int test_sample_if(std::mt19937& re) {
-	pw_element elem;
-
-	/*int i=0;
-	while (i<1000) {
-		std::sample(elements.begin(),elements.end(),&elem,1,re);
-		if (!is_vowel(elem.flags)) {
-			//std::cout << "what" << std::endl;
-		} else {
-			std::cout << elem.str << ", ";
-			++i;
+//
+// Compiles the candidate tables and the decoration rules into the transitions of each state.  
+// A step used to be an element pick followed by up to three randdig() (0-9) tests:  
+// -> Uppercase the element if randdig() < 2 (p == 0.2), if opts.uppers and tbl.may_upper, 
+//    and only at the start of a word or for a consonant.  
+// -> Prepend a digit if randdig() < 3 (p == 0.3), if opts.digits, except at the start.  
+// -> Prepend a symbol if randdig() < 2 (p == 0.2), if opts.symbols and the element may 
+//    appear first; it goes after the digit.  
+// Each transition is one combination of (element, upper?, digit?, symbol?), w/ weight 
+// (the element's weight * its multiplicity in the state's table) * (out of 10 for each test) * 
+// (digits.size() * symbols.size(), so that each digit/symbol char is a whole number of 
+// units).  The probabilities of every step are then exactly those of the old draws.  
+//
+void compile_automaton(const pw_opts_t& opts, phoneme_tables_t& tbl) {
+	const std::uint32_t ndigits = opts.digits ? static_cast<std::uint32_t>(tbl.digits.size()) : 1;
+	const std::uint32_t nsymbols = opts.symbols ? static_cast<std::uint32_t>(tbl.symbols.size()) : 1;
+	tbl.required = (opts.digits ? cflag::digit : 0) | (opts.uppers ? cflag::upper : 0) 
+		| (opts.symbols ? cflag::symbol : 0);
+
+	const std::array<const std::vector<int>*,3> cands {&tbl.first, &tbl.after_consonant, 
+		&tbl.after_vowel};
+	for (int s=0; s<3; ++s) {
+		std::array<std::uint32_t,elements.size()> mult {};
+		for (const auto& i : *cands[s]) { ++mult[i]; }
+
+		struct weighted_t {
+			std::uint32_t w;
+			std::uint8_t len;
+			pw_transition_t t;
+		};
+		std::vector<weighted_t> ws {};
+		for (std::size_t i=0; i<elements.size(); ++i) {
+			if (mult[i] == 0) { continue; }
+			const auto& e = elements[i];
+			const bool can_upper = (opts.uppers && tbl.may_upper[i] 
+				&& (s == st_start || is_consonant(e.flags)));
+			const bool can_digit = (opts.digits && s != st_start);
+			const bool can_symbol = (opts.symbols && may_appear_first(e.flags));
+			for (int f=0; f<8; ++f) {
+				const bool u = (f & cflag::upper);
+				const bool d = (f & cflag::digit);
+				const bool y = (f & cflag::symbol);
+				if ((u && !can_upper) || (d && !can_digit) || (y && !can_symbol)) { continue; }
+				const std::uint32_t w = e.weight * mult[i] * (can_upper ? (u ? 2 : 8) : 10) 
+					* (can_digit ? (d ? 3 : 7) : 10) * (can_symbol ? (y ? 2 : 8) : 10);
+				pw_transition_t t {};
+				t.unit = w * (d ? 1 : ndigits) * (y ? 1 : nsymbols);
+				t.text = u ? to_upper(e) : e;
+				t.features = static_cast<std::uint8_t>(f);
+				t.next = is_consonant(e.flags) ? st_consonant : st_vowel;
+				ws.push_back({w*ndigits*nsymbols, static_cast<std::uint8_t>(e.len + d + y), t});
+			}
 		}
-	}*/
 
-	auto pred_is_vowel = [](const pw_element& pwe) -> bool { return is_vowel(pwe.flags); };
+		// Lay out the transitions group by group
+		auto key = [](const weighted_t& a) -> int {
+			return (a.len << 8) | (a.t.next << 4) | a.t.features;
+		};
+		std::stable_sort(ws.begin(),ws.end(),
+			[&key](const weighted_t& a, const weighted_t& b) -> bool { return key(a) < key(b); });
+		auto& trans = tbl.trans[s];
+		auto& groups = tbl.groups[s];
+		trans.clear();
+		groups.clear();
+		std::uint64_t first {0};
+		for (std::size_t j=0; j<ws.size(); ++j) {
+			if (j == 0 || key(ws[j]) != key(ws[j-1])) {
+				pw_tgroup_t g {};
+				g.first = static_cast<std::uint32_t>(first);
+				g.len = ws[j].len;
+				g.next = ws[j].t.next;
+				g.features = ws[j].t.features;
+				groups.push_back(g);
+			}
+			groups.back().weight += ws[j].w;
+			++groups.back().ntrans;
+			ws[j].t.first = static_cast<std::uint32_t>(first);
+			trans.push_back(ws[j].t);
+			first += ws[j].w;
+			if (first > UINT32_MAX) {
+				throw pw_error("The phoneme element weights are too large");
+			}
+		}
+		tbl.total[s] = static_cast<std::uint32_t>(first);
+
+		// An alias table per group (Vose's method), over the units of its transitions over 
+		// their gcd; nsub is the same for the whole group.  Column k belongs to transition k:  
+		// a transition w/ less than height draws left fills its own column and the rest of 
+		// the column goes to one w/ more.  With integer draws, the ones left last have exactly 
+		// height, so the picks are exact.  
+		auto& alias = tbl.alias[s];
+		alias.clear();
+		std::size_t t0 {0};
+		for (auto& g : groups) {
+			const std::uint32_t n = g.ntrans;
+			std::uint32_t d {0};
+			for (std::uint32_t k=0; k<n; ++k) {
+				d = std::gcd(d,trans[t0+k].unit);
+			}
+			const std::uint32_t nsub = ((g.features & cflag::digit) ? ndigits : 1) 
+				* ((g.features & cflag::symbol) ? nsymbols : 1);
+			std::uint64_t height {0};
+			std::vector<std::uint64_t> mass(n);
+			std::vector<std::uint64_t> pos(n,0);
+			for (std::uint32_t k=0; k<n; ++k) {
+				mass[k] = std::uint64_t {n} * (trans[t0+k].unit/d) * nsub;
+				height += (trans[t0+k].unit/d) * nsub;
+				trans[t0+k].span = n * (trans[t0+k].unit/d);
+			}
+			if (n*height > UINT32_MAX) {
+				throw pw_error("The phoneme element weights are too large");
+			}
+			g.col = static_cast<std::uint32_t>(alias.size());
+			g.height = static_cast<std::uint32_t>(height);
+			alias.resize(alias.size() + n);
+			auto *col = alias.data() + g.col;
+			std::vector<std::uint16_t> small {};
+			std::vector<std::uint16_t> large {};
+			for (std::uint32_t k=0; k<n; ++k) {
+				(mass[k] < height ? small : large).push_back(static_cast<std::uint16_t>(k));
+			}
+			while (small.size() > 0 && large.size() > 0) {
+				const auto a = small.back();
+				const auto b = large.back();
+				small.pop_back();
+				col[a] = {static_cast<std::uint32_t>(mass[a]), static_cast<std::uint16_t>(t0+a), 
+					static_cast<std::uint16_t>(t0+b), static_cast<std::uint32_t>(pos[a]), 
+					static_cast<std::uint32_t>(pos[b])};
+				pos[a] += mass[a];
+				pos[b] += height - mass[a];
+				mass[b] -= height - mass[a];
+				if (mass[b] < height) {
+					large.pop_back();
+					small.push_back(b);
+				}
+			}
+			for (const auto& k : large) {
+				col[k] = {static_cast<std::uint32_t>(height), static_cast<std::uint16_t>(t0+k), 
+					static_cast<std::uint16_t>(t0+k), static_cast<std::uint32_t>(pos[k]), 0};
+			}
+			t0 += n;
+		}
+	}
 
-	for (int i=0; i<1000; ++i) {
-		sample_if(elements.begin(),elements.end(),&elem,re,pred_is_vowel);
-		if (!is_vowel(elem.flags)) {
-			std::cout << "what" << std::endl;
-		} else {
-			std::cout << elem.str << ", ";
+	// ncomplete[r][s][m] = sum over the groups g of s of 
+	//   (weight of g / total[s]) * ncomplete[r - g.len][g.next][m less g.features]
+	const int len = opts.pw_length;
+	tbl.pw_length = len;
+	tbl.ncomplete.assign(8*3*(std::max(len,0)+1),0.0);
+	for (int s=0; s<3; ++s) {
+		tbl.ncomplete[s*8 + 0] = 1.0;
+	}
+	for (int r=1; r<=len; ++r) {
+		for (int s=0; s<3; ++s) {
+			for (int m=0; m<8; ++m) {
+				double p {0.0};
+				for (const auto& g : tbl.groups[s]) {
+					if (g.len > r) { continue; }
+					p += g.weight*tbl.ncomplete[((r-g.len)*3 + g.next)*8 + (m & ~g.features)];
+				}
+				tbl.ncomplete[(r*3 + s)*8 + m] = p/tbl.total[s];
+			}
 		}
 	}
 
-	return 0;
+	// The weight of each group in each (r, s, m) is then a lookup; see pw_phonemes()
+	for (int s=0; s<3; ++s) {
+		const auto& groups = tbl.groups[s];
+		auto& cum = tbl.group_cum[s];
+		cum.assign((len+1)*8*groups.size(),0.0);
+		for (int r=0; r<=len; ++r) {
+			for (int m=0; m<8; ++m) {
+				double sum {0.0};
+				for (std::size_t j=0; j<groups.size(); ++j) {
+					const auto& g = groups[j];
+					if (g.len <= r) {
+						sum += g.weight*tbl.ncomplete[((r-g.len)*3 + g.next)*8 + (m & ~g.features)];
+					}
+					cum[(r*8 + m)*groups.size() + j] = sum;
+				}
+			}
+		}
+	}
 }
 
-int stats() {
-	struct stats_t {
-		int is_vowel {0};
-		int is_dipth {0};
-		int is_vowel_dipth {0};
-		int is_consonant {0};
-		int is_first {0};
-	};
-
-	stats_t counts {};
-	for (int i=0; i<elements.size(); ++i) {
-		counts.is_vowel += is_vowel(elements[i].flags);
-		counts.is_dipth += is_dipthong(elements[i].flags);
-		counts.is_vowel_dipth += is_vowel_and_dipth(elements[i].flags);
-		counts.is_consonant += is_consonant(elements[i].flags);
-		counts.is_first += may_appear_first(elements[i].flags);
+std::string dump_phoneme_automaton(const phoneme_tables_t& tbl) {
+	const std::array<const char*,3> names {"start", "consonant", "vowel"};
+	const std::uint32_t ndigits = tbl.digits.size() > 0 ? tbl.digits.size() : 1;
+	const std::uint32_t nsymbols = tbl.symbols.size() > 0 ? tbl.symbols.size() : 1;
+	std::string s {};
+	std::array<char,128> line {};
+	std::snprintf(line.data(),line.size(),"%-10s %-8s %-10s %12s %10s\n",
+		"state","step","next","weight","p");
+	s += line.data();
+	for (int st=0; st<3; ++st) {
+		for (const auto& t : tbl.trans[st]) {
+			std::string step {};
+			if (t.features & cflag::digit) { step += "<d>"; }
+			if (t.features & cflag::symbol) { step += "<s>"; }
+			step.append(t.text.str,t.text.len);
+			const std::uint32_t nsub = ((t.features & cflag::digit) ? ndigits : 1) 
+				* ((t.features & cflag::symbol) ? nsymbols : 1);
+			const std::uint32_t w = t.unit*nsub;
+			std::snprintf(line.data(),line.size(),"%-10s %-8s %-10s %12u %10.6f\n",
+				names[st],step.c_str(),names[t.next],w,w/static_cast<double>(tbl.total[st]));
+			s += line.data();
+		}
 	}
-
-	std::cout << "is_vowel:\t" << counts.is_vowel << "\n";
-	std::cout << "is_dipth:\t" << counts.is_dipth << "\n";
-	std::cout << "is_vowel_dipth:\t" << counts.is_vowel_dipth << "\n";
-	std::cout << "is_consonant:\t" << counts.is_consonant << "\n";
-	std::cout << "is_first:\t" << counts.is_first << "\n";
-	std::cout << std::endl;
-
-	return 0;
+	return s;
 }
 
-std::string pw_phonemes(const pw_opts_t& opts, std::mt19937& re) {
-	// opts.no_vowels is not enforced
-
-	std::string pw_digits_all = {"0123456789"};
-	std::string pw_symbols_all = {"!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~"};
-	std::string pw_ambiguous_all = {"B8G6I1l0OQDS5Z2"};
-
-	std::string pw_digits {pw_digits_all};
-	std::string pw_symbols {pw_symbols_all};
-	
-
-	auto randdig = [&re]() -> int {
-		std::uniform_int_distribution rd(0,9);
-		return rd(re);
-	};
-
-	struct currfail_t {
-		int a {0};
-		int b {0};
-		int c {0};
-		int d {0};
-		int e {0};
-		int f {0};
-		int g {0};
+//
+// The acceptance rules pw_phonemes() used to apply by rejection (sample_if() over all of 
+// elements[]) are folded into the tables:
+// -> Start of a word:  a consonant that may appear first.  
+// -> After a consonant:  any vowel.  
+// -> After a vowel:  any consonant, or a vowel that is not also a dipthong.  A vowel was 
+//    accepted w/ p == 0.4 relative to a consonant, so each consonant is entered 5 times and 
+//    each (single) vowel 2 times.  
+// An element is dropped if it contains a char in the drop set (opts.remove_chars + 
+// pw_ambiguous_all if opts.no_ambiguous + pw_vowels_all if opts.no_vowels), and may not be 
+// capitalized if its uc form contains one.  If filtering empties a state (ex: -v removes 
+// every vowel), that state draws from every surviving element.  
+//
+phoneme_tables_t make_phoneme_tables(const pw_opts_t& opts) {
+	std::array<bool,256> drop {};
+	auto add_drop = [&drop](const std::string& s) -> void {
+		for (const auto& c : s) { drop[static_cast<unsigned char>(c)] = true; }
 	};
-	currfail_t currfail {};
-
-	struct nfail_t {
-		int upper {0};
-		int digit {0};
-		int symbol {0};
-		int length {0};
+	auto is_dropped = [&drop](const pw_element& e) -> bool {
+		return std::any_of(e.str,e.str+e.len,
+			[&drop](char c) -> bool { return drop[static_cast<unsigned char>(c)]; });
 	};
-	nfail_t nfail {};
-	int nclears {0};
-
-	std::string passwd {};  passwd.reserve(opts.pw_length);
-	struct passwd_features_t {
-		bool has_upper {false};
-		bool has_digit {false};
-		bool has_symbol {false};
+	add_drop(opts.remove_chars);
+	if (opts.no_ambiguous) { add_drop(pw_ambiguous_all); }
+	if (opts.no_vowels) { add_drop(pw_vowels_all); }
+
+	phoneme_tables_t tbl {};
+	tbl.may_upper.resize(elements.size(),false);
+	std::vector<int> survivors {};
+	bool any_upper {false};
+	for (std::size_t i=0; i<elements.size(); ++i) {
+		if (is_dropped(elements[i])) {
+			continue;
+		}
+		survivors.push_back(i);
+		tbl.may_upper[i] = !is_dropped(to_upper(elements[i]));
+		any_upper |= (tbl.may_upper[i] && is_consonant(elements[i].flags));
+	}
+	auto survives = [&survivors](int i) -> bool {
+		return std::find(survivors.begin(),survivors.end(),i) != survivors.end();
 	};
-	passwd_features_t curr_pw_features {};
 
-	pw_element curr_elem;
-	pw_element prev_elem;
+	for (const auto& i : first_consonant_elements) {
+		if (survives(i)) { tbl.first.push_back(i); }
+	}
+	for (const auto& i : vowel_elements) {
+		if (survives(i)) { tbl.after_consonant.push_back(i); }
+	}
+	for (const auto& i : consonant_elements) {
+		if (survives(i)) { tbl.after_vowel.insert(tbl.after_vowel.end(),5,i); }
+	}
+	for (const auto& i : single_vowel_elements) {
+		if (survives(i)) { tbl.after_vowel.insert(tbl.after_vowel.end(),2,i); }
+	}
+	if (survivors.size() == 0) {
+		throw pw_error("No phoneme elements left in the valid set");
+	}
+	for (auto *t : {&tbl.first, &tbl.after_consonant, &tbl.after_vowel}) {
+		if (t->size() == 0) { *t = survivors; }
+	}
+	if (opts.uppers && !any_upper) {
+		throw pw_error("No uppers left in the valid set");
+	}
+
+	std::copy_if(pw_digits_all.begin(),pw_digits_all.end(),std::back_inserter(tbl.digits),
+		[&drop](char c) -> bool { return !drop[static_cast<unsigned char>(c)]; });
+	if (opts.digits && tbl.digits.size() == 0) {
+		throw pw_error("No digits left in the valid set");
+	}
+	std::copy_if(pw_symbols_all.begin(),pw_symbols_all.end(),std::back_inserter(tbl.symbols),
+		[&drop](char c) -> bool { return !drop[static_cast<unsigned char>(c)]; });
+	if (opts.symbols && tbl.symbols.size() == 0) {
+		throw pw_error("No symbols left in the valid set");
+	}
+
+	compile_automaton(opts,tbl);
+	if (opts.pw_length > 0 && tbl.ncomplete[(opts.pw_length*3 + st_start)*8 + tbl.required] == 0.0) {
+		throw pw_error("No phoneme passwords of length " + std::to_string(opts.pw_length) 
+			+ " w/ the required chars");
+	}
+	return tbl;
+}
+
+//
+// Writes exactly opts.pw_length chars to dest.  Each step picks a group of transitions (same 
+// length, next state and features), weighted by the group's probability times the chance 
+// that a passwd of exactly the remaining length w/ the still missing features can follow 
+// (tbl.ncomplete, cumulated over the groups in tbl.group_cum), then a transition within the 
+// group by its weight, w/ one draw from the group's alias table.  A step that could 
+// only overshoot, or that would leave a required feature out of reach, has weight 0, so 
+// there are no restarts; and since these weights are the conditional probabilities of the 
+// automaton's own walk, the passwds have the same distribution as when pw_phonemes() 
+// restarted every passwd that overshot or lacked a feature.  
+//
+void pw_phonemes(const pw_opts_t& opts, const phoneme_tables_t& tbl, pw_rng_t& re, 
+					char *dest, pw_stats_t *stats) {
+	const auto ndigits = tbl.digits.size();
+	int len {0};  // Chars of dest written so far
+	int state {st_start};
+	std::uint8_t features {0};  // cflag bits of the passwd so far
+	std::array<char,4> step {};
 	int titer {0};
-	while (passwd.size() < opts.pw_length) {
+	while (len < opts.pw_length) {
 		++titer;
-		//curr_elem = rand_elem();
-		std::sample(elements.begin(),elements.end(),&curr_elem,1,re);
-
-		if (passwd.size() == 0 || is_digit(passwd.back())) {  // First iter
-			auto whatever = [&randdig](const pw_element& pwe) -> bool {
-				return (may_appear_first(pwe.flags)
-					&& (is_consonant(pwe.flags) && randdig()>=4));
-			};
-			if (passwd.size()>0) { 
-				bool bback = is_digit(passwd.back());
-				auto back = passwd.back();
-				//std::cout << "digit";
-			}
-			sample_if(elements.begin(),elements.end(),&curr_elem,re,whatever);
-			//std::cout << "First:  " << prev_elem.str << " -> " << curr_elem.str << "\n";
-			/*if (!may_appear_first(curr_elem.flags)) {
-				++currfail.a; continue;
-			}
-			if (randdig()>4 && is_consonant(curr_elem.flags)) {
-				++currfail.b; continue;
-			}*/
-		} else {  // Not the first iter
-			if (is_consonant(prev_elem.flags)) {  // prev_elem was a consonant
-				
-				auto nfirst_cons = [](const pw_element& pwe) -> bool {
-					return is_vowel(pwe.flags);
-				};
-				sample_if(elements.begin(),elements.end(),&curr_elem,re,nfirst_cons);
-				//std::cout << "prev=>cons:  " << prev_elem.str << " -> " << curr_elem.str << "\n";
-
-				/*if (!is_vowel(curr_elem.flags)) {  // a cons must always be followed by a vowel
-					++currfail.c; continue;
-				}*/
-				//if (randdig()>7 && is_consonant(curr_elem.flags)) {
-				//	++currfail.c; continue;
-				//}
-			} else {  // prev elem was a vowel
-				// Want to allow elements that are one of vowel, dipthong, but forbid elements
-				// that are _both_ vowel, dipthong
-				if (is_vowel_and_dipth(curr_elem.flags)) {
-					++currfail.d; continue;
-				}
-				if (randdig()>3 && !is_consonant(curr_elem.flags)) {
-					++currfail.e; continue;
-				}
-			}
-
-			/*if (is_digit(passwd.back())) {
-				// Can't pick up after a digit w/ something marked "not first."  These are the
-				// same conditions as are set on the very first iter.  
-				if (!may_appear_first(curr_elem.flags)) {
-					++currfail.f; continue;
-				}
-				if (randdig()>4 && is_consonant(curr_elem.flags)) {
-					++currfail.g; continue;
-				}
-			} else {  // prev elem was not a digit
-				// curr_require |= eflag::not_first;  // means forbid first => require not_first (?)
-			}*/
+		const int r = opts.pw_length - len;
+		const int m = tbl.required & ~features;
+		const auto& groups = tbl.groups[state];
+		const double *cum = tbl.group_cum[state].data() + (r*8 + m)*groups.size();
+		const double u = re.uniform01()*cum[groups.size()-1];
+		std::size_t j {0};
+		while (j+1 < groups.size() && u >= cum[j]) { ++j; }
+		const auto& g = groups[j];
+
+		const std::uint32_t x = re.below(g.ntrans*g.height);
+		const auto& c = tbl.alias[state][g.col + x/g.height];
+		const std::uint32_t y = x % g.height;
+		const auto t = tbl.trans[state].begin() + (y < c.cut ? c.own : c.alias);
+
+		// The sub-outcome picks the digit and/or symbol char
+		std::uint32_t sub = (y < c.cut ? c.own_pos + y : c.alias_pos + (y - c.cut))/t->span;
+		int step_len {0};
+		if (t->features & cflag::digit) {
+			step[step_len++] = tbl.digits[sub % ndigits];
+			sub /= ndigits;
 		}
-
-		// Uppers flag:  Require >= 1 uc char
-		if (opts.uppers) {
-			if ((randdig() < 2)
-				&& (passwd.size()==0 || is_digit(passwd.back()) || is_consonant(curr_elem.flags))) {
-				std::transform(curr_elem.str.begin(),curr_elem.str.end(),curr_elem.str.begin(),::toupper);
-				curr_pw_features.has_upper = true;
-			}
+		if (t->features & cflag::symbol) {
+			step[step_len++] = tbl.symbols[sub];
 		}
+		step[step_len++] = t->text.str[0];
+		if (t->text.len == 2) { step[step_len++] = t->text.str[1]; }
 
-		// Digits flag:  Require >= 1 digit
-		// If curr_elem can go first, maybe append a digit before appending curr_elem.  
-		if (opts.digits) {
-			if ((randdig()<3) 
-				&& passwd.size() > 0 && !is_digit(passwd.back())) {
-				//passwd += rand_char(pw_digits);
-				std::sample(pw_digits.begin(),pw_digits.end(),std::back_inserter(passwd),1,re);
-				curr_pw_features.has_digit = true;
-			}
-		}
+		std::copy(step.begin(),step.begin()+step_len,dest+len);
+		len += step_len;
+		state = t->next;
+		features |= t->features;
+	}  // Next step
 
-		// Symbols flag:  Require >= 1 symbol
-		// If curr_elem can go first, maybe append a symbol before appending curr_elem.  
-		if (opts.symbols) {
-			if ((randdig()<2) && may_appear_first(curr_elem.flags)) {
-				//passwd += rand_char(pw_symbols);
-				std::sample(pw_symbols.begin(),pw_symbols.end(),std::back_inserter(passwd),1,re);
-				curr_pw_features.has_symbol = true;
-			}
-		}
+	if (stats) {
+		stats->titer += titer;
+	}
+}
 
-		passwd += curr_elem.str;
-
-		prev_elem = curr_elem;
-
-		if (passwd.size() == opts.pw_length) {
-			if ((opts.uppers && !curr_pw_features.has_upper) 
-				|| (opts.digits && !curr_pw_features.has_digit) 
-				|| (opts.symbols && !curr_pw_features.has_symbol)) {
-				// The current passwd is the correct length but does not have all the 
-				// features required by opts; restart
-				if (opts.uppers && !curr_pw_features.has_upper) { ++nfail.upper; }
-				if (opts.digits && !curr_pw_features.has_digit) { ++nfail.digit; }
-				if (opts.symbols && !curr_pw_features.has_symbol) { ++nfail.symbol; }
-				++nclears;
-				passwd.clear();
-				curr_pw_features = passwd_features_t {};
-			}
-		} else if (passwd.size() > opts.pw_length) {
-			++nfail.length;
-			++nclears;
-			passwd.clear();
-			curr_pw_features = passwd_features_t {};
-		}
-	}  // Generate next curr_elem
-	
+std::string pw_phonemes(const pw_opts_t& opts, const phoneme_tables_t& tbl, pw_rng_t& re) {
+	std::string passwd(opts.pw_length,'\0');
+	pw_phonemes(opts,tbl,re,passwd.data());
 	return passwd;
 }
 
 
 
-	//auto rand_char = [&re](const std::string& s) -> char {
-	//	if (s.size() == 0) {
-	//		std::abort();
-	//	}
-	//	std::uniform_int_distribution rd(0,static_cast<int>(s.size())-1);
-	//	return s[rd(re)];
-	//};
-	//auto rand_elem = [&re]() -> pw_element {
-	//	std::uniform_int_distribution rd(0,static_cast<int>(elements.size())-1);
-	//	return elements[rd(re)];
-	//};
-
-
-
-
-
 /*
 namespace tso {
 
@@ -5,10 +5,14 @@
 //
 
 #include <string>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
 #include <algorithm>
 #include <random>
 #include <iostream>
 #include "pwgen.h"
+#include "pw_cpu.h"
 
 const std::string pw_digits {"0123456789"};
 const std::string pw_uppers {"ABCDEFGHIJKLMNOPQRSTUVWXYZ"};
@@ -17,88 +21,363 @@ const std::string pw_symbols {"!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~"};
 const std::string pw_ambiguous {"B8G6I1l0OQDS5Z2"};
 const std::string pw_vowels {"01aeiouyAEIOUY"};
 
+// The classes in the order make_charset_plan() adds them to chars; see class_size
+constexpr std::array<std::uint8_t,4> pw_class_flags {0, cflag::digit, cflag::upper, cflag::symbol};
 
-std::string pw_rand(const pw_opts_t& opts) {
-	std::string drop_chars {};
-	drop_chars.reserve(opts.remove_chars.size()+pw_ambiguous.size()+pw_vowels.size());
-	drop_chars += opts.remove_chars;
-	if (opts.no_ambiguous) { drop_chars += pw_ambiguous; }
-	if (opts.no_vowels) { drop_chars += pw_vowels; }
+void build_ncover(charset_plan_t&);
 
-	std::string chars {};
-	
-	chars += pw_lowers;
-	if (opts.digits) {
-		std::string digits {};
-		std::set_difference(pw_digits.begin(),pw_digits.end(),
-		drop_chars.begin(),drop_chars.end(),
-		std::back_inserter(digits));
 
-		if (digits.size() == 0) {
-			std::cerr << "Error: No digits left in the valid set\n" << std::endl;
-			std::abort();
+//
+// The drop set is a lookup table rather than a sorted string:  the std::set_difference() 
+// this replaces required drop_chars to be sorted, which it never was.  
+//
+charset_plan_t make_charset_plan(const pw_opts_t& opts) {
+	std::array<bool,256> drop {};
+	auto add_drop = [&drop](const std::string& s) -> void {
+		for (const auto& c : s) { drop[static_cast<unsigned char>(c)] = true; }
+	};
+	add_drop(opts.remove_chars);
+	if (opts.no_ambiguous) { add_drop(pw_ambiguous); }
+	if (opts.no_vowels) { add_drop(pw_vowels); }
+
+	charset_plan_t plan {};
+	plan.pw_length = opts.pw_length;
+	auto add_class = [&drop,&plan](const std::string& s, std::uint8_t cf) -> int {
+		int n {0};
+		for (const auto& c : s) {
+			if (drop[static_cast<unsigned char>(c)]) { continue; }
+			plan.chars += c;
+			plan.cls[static_cast<unsigned char>(c)] |= cf;
+			++n;
 		}
-		chars += digits;
+		return n;
+	};
+
+	plan.class_size[0] = add_class(pw_lowers,0);
+	if (opts.digits) {
+		plan.class_size[1] = add_class(pw_digits,cflag::digit);
+		if (plan.class_size[1] == 0) {
+			throw pw_error("No digits left in the valid set");
+		}
+		plan.required |= cflag::digit;
 	}
 	if (opts.uppers) {
-		std::string uppers {};
-		std::set_difference(pw_uppers.begin(),pw_uppers.end(),
-		drop_chars.begin(),drop_chars.end(),
-		std::back_inserter(uppers));
-
-		if (uppers.size() == 0) {
-			std::cerr << "Error: No uppers left in the valid set\n" << std::endl;
-			std::abort();
+		plan.class_size[2] = add_class(pw_uppers,cflag::upper);
+		if (plan.class_size[2] == 0) {
+			throw pw_error("No uppers left in the valid set");
 		}
-		chars += uppers;
+		plan.required |= cflag::upper;
 	}
 	if (opts.symbols) {
-		std::string symbols {};
-		std::set_difference(pw_symbols.begin(),pw_symbols.end(),
-		drop_chars.begin(),drop_chars.end(),
-		std::back_inserter(symbols));
+		plan.class_size[3] = add_class(pw_symbols,cflag::symbol);
+		if (plan.class_size[3] == 0) {
+			throw pw_error("No symbols left in the valid set");
+		}
+		plan.required |= cflag::symbol;
+	}
+	if (plan.chars.size() == 0) {
+		throw pw_error("No characters left in the valid set");
+	}
+	// As in the C version (feature_flags = (size > 2) ? pw_flags : 0):  2-char passwds don't 
+	// have to include every class, which they couldn't w/ -y.  
+	if (opts.pw_length <= 2) {
+		plan.required = 0;
+	}
+
+	const int n = static_cast<int>(plan.chars.size());
+	plan.limit = 256 - (256 % n);
+	for (int b=0; b<plan.limit; ++b) {
+		plan.lut[b] = plan.chars[b % n];
+	}
+	plan.simd = cpu_has_avx2();
 
-		if (symbols.size() == 0) {
-			std::cerr << "Error: No symbols left in the valid set\n" << std::endl;
-			std::abort();
+	plan.constructive = (opts.constructive && plan.required != 0);
+	if (plan.constructive) {
+		if (opts.pw_length > pw_constructive_max_length) {
+			throw pw_error("--constructive passwords can't be longer than " 
+				+ std::to_string(pw_constructive_max_length));
 		}
-		chars += symbols;
+		build_ncover(plan);
 	}
 
-	auto contains = [](const std::string& hstk, const char ndl) -> bool {
-		return (std::find(hstk.begin(),hstk.end(),ndl) != pw_digits.end());
-	};
+	return plan;
+}
 
-	std::default_random_engine re {};
-	std::uniform_int_distribution rd {size_t {0}, chars.size()-1};
 
-	std::string passwd {};  passwd.reserve(opts.pw_length);
-	bool has_digit {false}; bool has_symbol {false}; bool has_upper {false};
-	while (passwd.size() < opts.pw_length) {
-		char curr_ch = chars[rd(re)];
-		passwd += curr_ch;
+//
+// Unsigned integers of any size as little-endian 32-bit limbs, w/ just the operations the 
+// constructive pw_rand() needs.  The in-place ops work mod 2^(32*n) on the n limbs of x.  
+//
+using limbs_t = std::vector<std::uint32_t>;
 
-		if (!has_digit && opts.digits) {
-			has_digit |= contains(pw_digits,curr_ch);
+// x += m*b; b.size() <= n
+void add_mul_small(std::uint32_t *x, std::size_t n, const limbs_t& b, std::uint32_t m) {
+	std::uint64_t carry {0};
+	for (std::size_t i=0; i<n; ++i) {
+		const std::uint64_t bi = (i < b.size()) ? b[i] : 0;
+		const std::uint64_t t = bi*m + x[i] + carry;
+		x[i] = static_cast<std::uint32_t>(t);
+		carry = t >> 32;
+	}
+}
+
+// x -= m*b if m*b <= x and returns true; else returns false w/ x unchanged
+bool sub_mul_small(std::uint32_t *x, std::size_t n, const limbs_t& b, std::uint32_t m) {
+	if (b.size() > n) { return false; }
+	std::uint64_t carry {0};
+	std::uint32_t borrow {0};
+	for (std::size_t i=0; i<n; ++i) {
+		const std::uint64_t bi = (i < b.size()) ? b[i] : 0;
+		const std::uint64_t p = bi*m + carry;
+		carry = p >> 32;
+		const std::uint64_t t = std::uint64_t {x[i]} - static_cast<std::uint32_t>(p) - borrow;
+		x[i] = static_cast<std::uint32_t>(t);
+		borrow = (t >> 32) ? 1 : 0;
+	}
+	if (borrow != 0 || carry != 0) {  // Wrapped around; undo it
+		add_mul_small(x,n,b,m);
+		return false;
+	}
+	return true;
+}
+
+// x /= m; returns x % m
+std::uint32_t divmod_small(std::uint32_t *x, std::size_t n, std::uint32_t m) {
+	std::uint64_t rem {0};
+	for (std::size_t i=n; i-- > 0; ) {
+		const std::uint64_t cur = (rem << 32) | x[i];
+		x[i] = static_cast<std::uint32_t>(cur/m);
+		rem = cur % m;
+	}
+	return static_cast<std::uint32_t>(rem);
+}
+
+//
+// ncover[8*r+m] = sum over the classes k of class_size[k]*ncover[8*(r-1) + (m less class k)]:  
+// the first char is from some class k, and the other r-1 must cover what k didn't.  Only 
+// the subsets m of plan.required are filled in; the rest stay 0.  
+//
+void build_ncover(charset_plan_t& plan) {
+	const int len = plan.pw_length;
+	plan.ncover.assign(8*(len+1),limbs_t {});
+	plan.ncover[0] = limbs_t {1};
+	for (int r=1; r<=len; ++r) {
+		for (int m=0; m<8; ++m) {
+			if ((m & ~plan.required) != 0) { continue; }
+			auto& acc = plan.ncover[8*r+m];
+			for (int k=0; k<4; ++k) {
+				const auto& b = plan.ncover[8*(r-1) + (m & ~pw_class_flags[k])];
+				if (plan.class_size[k] == 0 || b.size() == 0) { continue; }
+				acc.resize(std::max(acc.size(),b.size())+1,0);
+				add_mul_small(acc.data(),acc.size(),b,plan.class_size[k]);
+				while (acc.size() > 0 && acc.back() == 0) { acc.pop_back(); }
+			}
 		}
-		if (!has_upper && opts.digits) {
-			has_upper |= contains(pw_uppers,curr_ch);
+	}
+}
+
+// Sets x (total.size() limbs) to a uniform integer in [0, total), comparing limb by limb 
+// from the top as they are drawn:  the masked top limb is < total's w/ probability > 1/2, 
+// and nearly every draw is decided at the top limb, so this takes about total.size() words.  
+void uniform_below(const limbs_t& total, pw_rng_t& re, std::uint32_t *x) {
+	const std::size_t n = total.size();
+	std::uint32_t mask = total[n-1];
+	mask |= mask >> 1;  mask |= mask >> 2;  mask |= mask >> 4;
+	mask |= mask >> 8;  mask |= mask >> 16;
+	for (;;) {
+		std::size_t i = n;
+		while (i-- > 0) {
+			x[i] = static_cast<std::uint32_t>(re());
+			if (i == n-1) { x[i] &= mask; }
+			if (x[i] != total[i]) { break; }
 		}
-		if (!has_symbol && opts.symbols) {
-			has_symbol |= contains(pw_symbols,curr_ch);
+		if (i < n && x[i] < total[i]) {
+			while (i-- > 0) { x[i] = static_cast<std::uint32_t>(re()); }
+			return;
 		}
-	
-		if (passwd.size() == opts.pw_length) {
-			if ((!has_symbol && opts.symbols)
-				|| (!has_upper && opts.digits)
-				|| (!has_digit && opts.digits)) {
-				// passwd is the right length but one or more of the char-inclusion requirements
-				// is not set.  
-				passwd.clear();
+		// x >= total (including x == total, where the loop ran off the bottom); redraw
+	}
+}
+
+// The kernels fill dest w/ len uniform chars and return the cflag bits of the classes it 
+// contains.  
+std::uint8_t pw_rand_scalar(const charset_plan_t& plan, pw_rng_t& re, char *dest, int len) {
+	const auto n = static_cast<std::uint32_t>(plan.chars.size());
+	std::uint8_t has {0};
+	for (int i=0; i<len; ++i) {
+		dest[i] = plan.chars[re.below(n)];
+		has |= plan.cls[static_cast<unsigned char>(dest[i])];
+	}
+	return has;
+}
+
+#if PW_HAVE_X86
+PW_TARGET_AVX2
+inline __m256i in_range_avx2(__m256i c, char first, char last) {
+	return _mm256_and_si256(_mm256_cmpgt_epi8(c,_mm256_set1_epi8(first-1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8(last+1),c));
+}
+
+//
+// 32 random bytes at a time:  bytes >= plan.limit are rejected w/ a vector compare; the 
+// rest are mapped through plan.lut as 16 rows of 16, w/ one pshufb per row on the low 
+// nibble selected by the high nibble.  Blocks w/o a rejected byte are stored directly; 
+// otherwise the accepted bytes are compacted by walking the movemask.  The class masks are 
+// then built by range compares over dest (every char is a lower, digit, upper or symbol).  
+// The chars are as uniform as pw_rand_scalar()'s but not the same ones for the same words, 
+// so a plan only uses this kernel if plan.simd; see charset_plan_t.  
+//
+PW_TARGET_AVX2
+std::uint8_t pw_rand_avx2(const charset_plan_t& plan, pw_rng_t& re, char *dest, int len) {
+	const int nrows = (plan.limit + 15)/16;
+	__m256i rows[16];
+	for (int h=0; h<nrows; ++h) {
+		rows[h] = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(plan.lut.data()+16*h)));
+	}
+	const __m256i lim = _mm256_set1_epi8(static_cast<char>(plan.limit-1));
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+	alignas(32) std::array<std::uint32_t,8> words {};
+	alignas(32) std::array<char,32> mapped {};
+	int i {0};
+	while (i < len) {
+		for (auto& w : words) { w = static_cast<std::uint32_t>(re()); }
+		const __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(words.data()));
+		const __m256i ok = _mm256_cmpeq_epi8(_mm256_min_epu8(b,lim),b);  // b <= limit-1
+		const __m256i lo = _mm256_and_si256(b,nibble);
+		const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(b,4),nibble);
+		__m256i out = _mm256_setzero_si256();
+		for (int h=0; h<nrows; ++h) {
+			const __m256i sel = _mm256_cmpeq_epi8(hi,_mm256_set1_epi8(static_cast<char>(h)));
+			out = _mm256_blendv_epi8(out,_mm256_shuffle_epi8(rows[h],lo),sel);
+		}
+
+		auto m = static_cast<std::uint32_t>(_mm256_movemask_epi8(ok));
+		if (m == 0xFFFFFFFFu && i+32 <= len) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest+i),out);
+			i += 32;
+		} else {
+			_mm256_store_si256(reinterpret_cast<__m256i*>(mapped.data()),out);
+			for (; m != 0 && i < len; m &= (m-1)) {
+				dest[i++] = mapped[ctz32(m)];
 			}
 		}
 	}
 
+	__m256i digits = _mm256_setzero_si256();
+	__m256i uppers = _mm256_setzero_si256();
+	__m256i symbols = _mm256_setzero_si256();
+	for (int j=0; j<len; j+=32) {
+		__m256i c {};
+		if (j+32 <= len) {
+			c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest+j));
+		} else {  // Pad the tail w/ a lower, which sets no class
+			mapped.fill('a');
+			std::copy(dest+j,dest+len,mapped.begin());
+			c = _mm256_load_si256(reinterpret_cast<const __m256i*>(mapped.data()));
+		}
+		const __m256i d = in_range_avx2(c,'0','9');
+		const __m256i u = in_range_avx2(c,'A','Z');
+		const __m256i l = in_range_avx2(c,'a','z');
+		digits = _mm256_or_si256(digits,d);
+		uppers = _mm256_or_si256(uppers,u);
+		symbols = _mm256_or_si256(symbols,
+			_mm256_andnot_si256(_mm256_or_si256(_mm256_or_si256(d,u),l),_mm256_set1_epi8(-1)));
+	}
+
+	std::uint8_t has {0};
+	if (_mm256_movemask_epi8(digits) != 0) { has |= cflag::digit; }
+	if (_mm256_movemask_epi8(uppers) != 0) { has |= cflag::upper; }
+	if (_mm256_movemask_epi8(symbols) != 0) { has |= cflag::symbol; }
+	return has;
+}
+#endif
+
+//
+// Every valid passwd is one number in [0, ncover[len][required]), drawn uniformly, so each is 
+// equally likely and there is no retry.  The number is decoded a char at a time:  w/ r chars 
+// left to place and the classes m still missing, the passwds starting w/ class k number 
+// class_size[k]*ncover[r-1][m less k], in blocks by k; within k's block, x % class_size[k] 
+// picks the char and x / class_size[k] numbers the rest of the passwd.  Once m is empty 
+// every string is valid, so the rest of x is uniform over all strings of the remaining 
+// length and independent of the chars so far; it is dropped and the tail is filled by the 
+// same kernels as the retry mode, which is much cheaper than decoding it limb by limb.  
+//
+void pw_rand_constructive(const charset_plan_t& plan, pw_rng_t& re, char *dest) {
+	const int len = plan.pw_length;
+	const limbs_t& total = plan.ncover[8*len + plan.required];
+	std::array<std::uint32_t,64> small {};
+	limbs_t big {};
+	std::size_t n = total.size();
+	std::uint32_t *x = small.data();
+	if (n > small.size()) {
+		big.resize(n);
+		x = big.data();
+	}
+	uniform_below(total,re,x);
+
+	std::array<int,4> first {};  // Index in chars of the first char of each class
+	for (int k=1; k<4; ++k) {
+		first[k] = first[k-1] + plan.class_size[k-1];
+	}
+	int m = plan.required;
+	int i {0};
+	for (; i<len && m != 0; ++i) {
+		while (n > 0 && x[n-1] == 0) { --n; }
+		const int r = len-i;
+		for (int k=0; k<4; ++k) {
+			const auto nk = static_cast<std::uint32_t>(plan.class_size[k]);
+			if (nk == 0) { continue; }
+			const limbs_t& block = plan.ncover[8*(r-1) + (m & ~pw_class_flags[k])];
+			if (!sub_mul_small(x,n,block,nk)) {  // x is in k's block
+				dest[i] = plan.chars[first[k] + divmod_small(x,n,nk)];
+				m &= ~pw_class_flags[k];
+				break;
+			}
+		}
+	}
+	if (i < len) {
+#if PW_HAVE_X86
+		if (plan.simd && len-i >= 32) {  // Shorter tails would waste most of a 32-byte draw
+			pw_rand_avx2(plan,re,dest+i,len-i);
+			return;
+		}
+#endif
+		pw_rand_scalar(plan,re,dest+i,len-i);
+	}
+}
+
+// Writes exactly plan.pw_length chars to dest
+void pw_rand(const charset_plan_t& plan, pw_rng_t& re, char *dest, pw_stats_t *stats) {
+	if (plan.constructive) {
+		pw_rand_constructive(plan,re,dest);
+		if (stats) { ++stats->titer; }
+		return;
+	}
+	// The SIMD kernel spends 8 bits on a char and draws 32 bytes at a time, which a short 
+	// passwd mostly wastes; below() spends bit_width(n-1) + 8 bits
+	auto kernel = pw_rand_scalar;
+#if PW_HAVE_X86
+	if (plan.simd && plan.pw_length >= 32) { kernel = pw_rand_avx2; }
+#endif
+	for (;;) {
+		const std::uint8_t missing = plan.required & ~kernel(plan,re,dest,plan.pw_length);
+		if (stats) { ++stats->titer; }
+		if (missing == 0) { break; }
+		// A passwd missing one or more of the required classes is redrawn in full
+		if (stats) {
+			++stats->nclears;
+			if (missing & cflag::upper) { ++stats->nfail.upper; }
+			if (missing & cflag::digit) { ++stats->nfail.digit; }
+			if (missing & cflag::symbol) { ++stats->nfail.symbol; }
+		}
+	}
+}
+
+std::string pw_rand(const charset_plan_t& plan, pw_rng_t& re) {
+	std::string passwd(plan.pw_length,'\0');
+	pw_rand(plan,re,passwd.data());
 	return passwd;
 }
 
@@ -200,3 +479,164 @@ try_again:
 }	
 */
 
+
+
+#if defined(TEST)
+
+#include <cstdio>
+#include <cmath>
+#include <map>
+
+// Fraction of uniform passwds w/ every required class, by the same recurrence as ncover
+double pw_rand_accept_rate(const charset_plan_t& plan) {
+	std::array<double,8> p {1.0};
+	const double nchars = static_cast<double>(plan.chars.size());
+	for (int r=1; r<=plan.pw_length; ++r) {
+		std::array<double,8> q {};
+		for (int m=0; m<8; ++m) {
+			for (int k=0; k<4; ++k) {
+				q[m] += (plan.class_size[k]/nchars)*p[m & ~pw_class_flags[k]];
+			}
+		}
+		p = q;
+	}
+	return p[plan.required];
+}
+
+//
+// 1) The constructive mode is uniform over the valid passwds:  every one of the 304 valid 
+//    4-char passwds over {a,b,1,C,D} w/ a digit and an upper appears, nothing else does, 
+//    and the counts pass a chi-square test; passwds longer than pw_constructive_max_length 
+//    are rejected.  
+// 2) The retry mode's retry rate, predicted and measured, and the RNG words per passwd of 
+//    both modes.  
+// 3) W/ the same seekable streams, a plan that may use the SIMD kernel gives the passwds 
+//    of one that may not, in both modes and at lengths the kernel would take.  
+//
+int main() {
+	int nfail {0};
+	chacha20_engine re(chacha20_key_t {1,2,3},0);
+
+	printf( "\n Constructive pw_rand() uniformity:\n\n" );
+	pw_opts_t opts {};
+	opts.random = true;
+	opts.constructive = true;
+	opts.pw_length = 4;
+	opts.remove_chars = "cdefghijklmnopqrstuvwxyz023456789ABEFGHIJKLMNOPQRSTUVWXYZ";
+	auto plan = make_charset_plan(opts);
+	const int nvalid = 5*5*5*5 - 4*4*4*4 - 3*3*3*3 + 2*2*2*2;  // Inclusion-exclusion
+	const auto& total = plan.ncover[8*plan.pw_length + plan.required];
+	if (total.size() != 1 || total[0] != static_cast<std::uint32_t>(nvalid)) {
+		printf( " Count of valid passwds failed!\n" );
+		++nfail;
+	}
+	const int per {1000};
+	std::map<std::string,int> counts {};
+	bool all_valid {true};
+	for (int i=0; i<nvalid*per; ++i) {
+		auto pw = pw_rand(plan,re);
+		std::uint8_t has {0};
+		for (const auto& c : pw) { has |= plan.cls[static_cast<unsigned char>(c)]; }
+		all_valid = all_valid && (has & plan.required) == plan.required;
+		++counts[pw];
+	}
+	double chi2 {0.0};
+	for (const auto& [pw, n] : counts) {
+		chi2 += (n-per)*(n-per)/static_cast<double>(per);
+	}
+	const int dof = nvalid-1;
+	const bool uniform = chi2 < dof + 6*std::sqrt(2.0*dof);
+	printf( " %zu of %d passwds seen, %s; chi2 = %.1f (dof %d) ",
+		counts.size(), nvalid, (all_valid ? "all valid" : "SOME INVALID"), chi2, dof );
+	if (!all_valid || counts.size() != nvalid || !uniform) {
+		printf( "failed!\n" );
+		++nfail;
+	} else {
+		printf( "passed.\n" );
+	}
+	bool too_long {false};
+	opts.remove_chars.clear();
+	opts.pw_length = pw_constructive_max_length + 1;
+	try {
+		make_charset_plan(opts);
+	} catch (const pw_error&) {
+		too_long = true;
+	}
+	printf( " Length > pw_constructive_max_length %s\n", too_long ? "rejected." : "failed!" );
+	nfail += too_long ? 0 : 1;
+
+	printf( "\n Retry rate of the retry mode:\n\n" );
+	printf( " %-26s %4s %12s %12s %12s %12s\n", "options", "len", "tries/pw", "measured", 
+		"words/pw", "construct." );
+	struct case_t {
+		const char *name;
+		bool symbols;
+		std::string remove_chars;
+		int pw_length;
+	};
+	const std::array<case_t,8> cases {{
+		{"-s", false, "", 3},
+		{"-s", false, "", 5},
+		{"-s", false, "", 8},
+		{"-sy", true, "", 3},
+		{"-sy", true, "", 4},
+		{"-sy", true, "", 8},
+		{"-sy -r <all but 2 syms>", true, "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}", 4},
+		{"-sy -r <all but 2 syms>", true, "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}", 12}
+	}};
+	for (const auto& c : cases) {
+		pw_opts_t o {};
+		o.random = true;
+		o.symbols = c.symbols;
+		o.remove_chars = c.remove_chars;
+		o.pw_length = c.pw_length;
+		auto retry = make_charset_plan(o);
+		retry.simd = false;
+		o.constructive = true;
+		const auto construct = make_charset_plan(o);
+
+		std::string pw(o.pw_length,'\0');
+		const int npw {100000};
+		long long ntries {0};
+		const auto d0 = re.draws();
+		for (int i=0; i<npw; ++i) {
+			do { ++ntries; } while ((pw_rand_scalar(retry,re,pw.data(),o.pw_length) & retry.required) != retry.required);
+		}
+		const auto d1 = re.draws();
+		for (int i=0; i<npw; ++i) {
+			pw_rand(construct,re,pw.data());
+		}
+		const auto d2 = re.draws();
+		printf( " %-26s %4d %12.4f %12.4f %12.2f %12.2f\n", c.name, c.pw_length,
+			1.0/pw_rand_accept_rate(retry), ntries/static_cast<double>(npw),
+			(d1-d0)/static_cast<double>(npw), (d2-d1)/static_cast<double>(npw) );
+	}
+
+	printf( "\n Seekable streams vs the SIMD kernel:\n\n" );
+	for (const bool constructive : {false, true}) {
+		pw_opts_t o {};
+		o.random = true;
+		o.symbols = true;
+		o.constructive = constructive;
+		o.pw_length = 40;
+		pw_plan_t simd = make_pw_plan(o);
+		simd.charset.simd = true;
+		pw_plan_t scalar = make_pw_plan(o);
+		scalar.charset.simd = false;
+		const pw_streams_t streams {chacha20_key_t {4,5,6}, 1000, 1, false, {}, true};
+		pw_generator_t a(simd,streams);
+		pw_generator_t b(scalar,streams);
+		bool same {true};
+		for (int i=0; i<1000; ++i) {
+			same = same && a.next() == b.next();
+		}
+		printf( " %-14s len %d %s\n", constructive ? "constructive" : "retry", o.pw_length,
+			same ? "passed." : "failed!" );
+		nfail += same ? 0 : 1;
+	}
+	printf( "\n" );
+
+	return nfail == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,229 @@
+// pw_ring.cpp -- a lock-free ring of ready passwds, and producer threads to fill it
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>  // std::memcpy()
+#include "pwgen.h"
+
+
+pw_ring_t::pw_ring_t(std::size_t capacity, int width) : w(width) {
+	std::size_t cap {2};
+	while (cap < capacity) { cap *= 2; }
+	seq = std::vector<std::atomic<std::size_t>>(cap);
+	for (std::size_t i=0; i<cap; ++i) {
+		seq[i].store(i,std::memory_order_relaxed);
+	}
+	slots.resize(cap*w);
+	mask = cap - 1;
+}
+
+// Cell i is free for the push at position pos when seq[i] == pos, and full for the pop at
+// pos when seq[i] == pos + 1; the pop then frees it for the push a lap later.  Positions
+// only grow, so the difference says whether the cell is ours, not yet ours (full / empty),
+// or already taken by another thread (reload the position and retry).
+bool pw_ring_t::try_push(const char *src) {
+	std::size_t pos = tail.pos.load(std::memory_order_relaxed);
+	while (true) {
+		auto& s = seq[pos & mask];
+		const auto dif = static_cast<std::ptrdiff_t>(s.load(std::memory_order_acquire) - pos);
+		if (dif == 0) {
+			if (tail.pos.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed)) {
+				std::memcpy(slots.data() + (pos & mask)*w,src,w);
+				s.store(pos+1,std::memory_order_release);
+				return true;
+			}
+		} else if (dif < 0) {
+			return false;
+		} else {
+			pos = tail.pos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool pw_ring_t::try_pop(char *dest) {
+	std::size_t pos = head.pos.load(std::memory_order_relaxed);
+	while (true) {
+		auto& s = seq[pos & mask];
+		const auto dif = static_cast<std::ptrdiff_t>(s.load(std::memory_order_acquire) - (pos+1));
+		if (dif == 0) {
+			if (head.pos.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed)) {
+				char *slot = slots.data() + (pos & mask)*w;
+				std::memcpy(dest,slot,w);
+				pw_wipe(slot,w);
+				s.store(pos+mask+1,std::memory_order_release);
+				return true;
+			}
+		} else if (dif < 0) {
+			return false;
+		} else {
+			pos = head.pos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+// The head first:  the tail read after it is at least as far along
+std::size_t pw_ring_t::size() const {
+	const std::size_t h = head.pos.load(std::memory_order_relaxed);
+	const std::size_t t = tail.pos.load(std::memory_order_relaxed);
+	return std::min(t - h,capacity());
+}
+
+
+pw_ring_pool_t::pw_ring_pool_t(const pw_plan_t& plan, std::size_t capacity, std::size_t lo,
+								std::size_t hi, int nproducers)
+		: ring(capacity,plan.opts.pw_length), low(lo), high(hi) {
+	if (low == 0 || low > high || high > ring.capacity()) {
+		throw pw_error("Ring watermarks need 0 < low <= high <= capacity");
+	}
+	if (nproducers == 0) {
+		nproducers = std::max(static_cast<int>(std::thread::hardware_concurrency()),1);
+	}
+	for (int i=0; i<nproducers; ++i) {
+		producers.emplace_back(&pw_ring_pool_t::produce,this,
+			pw_generator_t(plan,pw_streams_t {chacha20_engine::os_key()}));
+	}
+}
+
+pw_ring_pool_t::~pw_ring_pool_t() {
+	{
+		std::lock_guard<std::mutex> lk(m);
+		stop = true;
+	}
+	below_low.notify_all();
+	for (auto& p : producers) {
+		p.join();
+	}
+}
+
+// woken is cleared before the producer checks the ring under the mutex, so a consumer that
+// takes the ring below low after that check sees it clear and wakes the producers
+void pw_ring_pool_t::produce(pw_generator_t gen) {
+	std::string pw(ring.width(),'\0');
+	std::unique_lock<std::mutex> lk(m);
+	while (true) {
+		below_low.wait(lk,[this]() -> bool { return stop || ring.size() < low; });
+		if (stop) { break; }
+		lk.unlock();
+		while (!stop && ring.size() < high) {
+			gen.next(pw.data());
+			if (!ring.try_push(pw.data())) { break; }  // Another producer filled it
+		}
+		woken.store(false);
+		lk.lock();
+	}
+	pw_wipe(pw.data(),pw.size());
+}
+
+bool pw_ring_pool_t::try_take(char *dest) {
+	const bool ok = ring.try_pop(dest);
+	if (ring.size() < low && !woken.load(std::memory_order_relaxed) && !woken.exchange(true)) {
+		std::lock_guard<std::mutex> lk(m);
+		below_low.notify_all();
+	}
+	if (!ok) {
+		nempty.fetch_add(1,std::memory_order_relaxed);
+	}
+	return ok;
+}
+
+void pw_ring_pool_t::take(char *dest) {
+	while (!try_take(dest)) {
+		std::this_thread::yield();
+	}
+}
+
+
+#if defined(TEST)
+
+#include <cstdio>
+#include <chrono>
+
+//
+// 1) 4 producers push 200000 distinct 8-byte slots each through a 1024-slot ring while
+//    4 consumers pop:  every slot comes out exactly once.
+// 2) A pool of 12-char phoneme passwds w/ 2 producers, taken by 4 threads:  every take
+//    gets a passwd of the plan, and the ring is left w/ at least low passwds.
+//
+int main() {
+	int nfail {0};
+	printf( "\n Ring Tests:\n\n" );
+
+	constexpr int nthreads {4};
+	constexpr std::uint64_t nper {200000};
+	pw_ring_t ring(1000,8);
+	std::vector<std::atomic<int>> seen(nthreads*nper);
+	std::atomic<std::uint64_t> npopped {0};
+	std::vector<std::thread> workers {};
+	for (int t=0; t<nthreads; ++t) {
+		workers.emplace_back([&ring,t]() -> void {
+			for (std::uint64_t i=0; i<nper; ++i) {
+				const std::uint64_t x = t*nper + i;
+				while (!ring.try_push(reinterpret_cast<const char*>(&x))) { std::this_thread::yield(); }
+			}
+		});
+		workers.emplace_back([&ring,&seen,&npopped]() -> void {
+			std::uint64_t x {0};
+			while (npopped.load() < nthreads*nper) {
+				if (ring.try_pop(reinterpret_cast<char*>(&x))) {
+					++seen[x];
+					++npopped;
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+	const bool once = std::all_of(seen.begin(),seen.end(),[](const std::atomic<int>& s) -> bool {
+		return s.load() == 1; });
+	const bool ok1 = once && ring.capacity() == 1024 && ring.size() == 0;
+	printf( " Test 1 (MPMC, %d+%d threads) %s\n", nthreads, nthreads, ok1 ? "passed." : "failed!" );
+	nfail += ok1 ? 0 : 1;
+
+	pw_opts_t opts {};
+	opts.pw_length = 12;
+	const pw_plan_t plan = make_pw_plan(opts);
+	std::atomic<bool> ok2 {true};
+	{
+		pw_ring_pool_t pool(plan,256,64,256,2);
+		std::vector<std::thread> consumers {};
+		for (int t=0; t<nthreads; ++t) {
+			consumers.emplace_back([&pool,&ok2]() -> void {
+				std::string pw(12,'\0');
+				for (int i=0; i<20000; ++i) {
+					pool.take(pw.data());
+					const bool good = std::all_of(pw.begin(),pw.end(),[](char c) -> bool {
+						return c > ' ' && c < 127; });
+					if (!good) { ok2 = false; }
+				}
+			});
+		}
+		for (auto& c : consumers) {
+			c.join();
+		}
+		for (int i=0; i<2000 && pool.size() < 64; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		ok2 = ok2 && pool.size() >= 64;
+	}
+	printf( " Test 2 (pool) %s\n", ok2 ? "passed." : "failed!" );
+	nfail += ok2 ? 0 : 1;
+	printf( "\n" );
+
+	return nfail == 0 ? 0 : 1;
+}
+
+#endif
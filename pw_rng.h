@@ -0,0 +1,144 @@
+#pragma once
+// pw_rng.h --- random engines for the password generators
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// Bits needed to write x:  0 for 0, else floor(log2(x)) + 1
+inline int pw_bit_width(std::uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return x == 0 ? 0 : 32 - __builtin_clz(x);
+#else
+	int n {0};
+	for (; x != 0; x >>= 1) { ++n; }
+	return n;
+#endif
+}
+
+//
+// A UniformRandomBitGenerator handing out 32-bit words from a buffer that the derived
+// engine refills in large blocks.  pw_phonemes() and pw_rand() take a pw_rng_t&, so any
+// engine derived from it plugs into both generators; the cost of the virtual refill() is
+// amortized over a whole buffer.  seek() restarts the engine at the start of another
+// stream; the refills after it start at 16 words and grow by 16 up to the whole buffer, so a
+// passwd drawn from a fresh stream pays for about the words it uses.  below() and
+// uniform01() draw from a buffer of bits instead of whole words; seek() empties it too.
+//
+class pw_rng_t {
+public:
+	using result_type = std::uint32_t;
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+	result_type operator()() {
+		if (pos == end) {
+			end = refill(buf.data(),nfill);
+			nfill = std::min(nfill+16,buf.size());
+			pos = 0;
+		}
+		++ndraws;
+		return buf[pos++];
+	}
+	std::uint64_t draws() const { return ndraws; }  // Words handed out so far (not reset by seek())
+
+	// Uniform in [0, n), 0 < n < 2^32, w/ Lemire's nearly divisionless method on b =
+	// min(bit_width(n-1) + 8, 32) random bits:  x*n >> b for a b-bit x, redrawn in the few
+	// cases (< 1 in 2^8 for n <= 2^24) where the low b bits of x*n fall below 2^b mod n, so
+	// the result is exactly uniform.  The bits come from a 64-bit buffer that keeps what a
+	// draw leaves of each word for the next ones, so a digit costs 12 bits, not a word.
+	std::uint32_t below(std::uint32_t n) {
+		const int b = std::min(pw_bit_width(n-1) + 8,32);
+		const std::uint64_t low_mask = (std::uint64_t {1} << b) - 1;
+		while (true) {
+			const std::uint64_t m = take_bits(b)*n;
+			const std::uint64_t l = m & low_mask;
+			if (l >= n || l >= (low_mask + 1 - n) % n) {
+				return static_cast<std::uint32_t>(m >> b);
+			}
+		}
+	}
+	// Uniform in [0, 1), 53 bits
+	double uniform01() {
+		const std::uint64_t x = (take_bits(27) << 26) | take_bits(26);
+		return static_cast<double>(x)*0x1.0p-53;
+	}
+
+	// Continues w/ block 0 of stream s (under the same key)
+	virtual void seek(std::uint64_t s) = 0;
+
+	virtual ~pw_rng_t() = default;
+protected:
+	// Fills at most n (>= 16) words of dest; returns the number written (> 0)
+	virtual std::size_t refill(std::uint32_t*, std::size_t) = 0;
+	void discard_buffer() { pos = end = 0;  nfill = 16;  bits = 0;  nbits = 0; }
+private:
+	// The low b <= 32 bits of the bit buffer, topped up w/ a whole word from the low end up
+	std::uint64_t take_bits(int b) {
+		if (nbits < b) {
+			bits |= static_cast<std::uint64_t>((*this)()) << nbits;
+			nbits += 32;
+		}
+		const std::uint64_t x = bits & ((std::uint64_t {1} << b) - 1);
+		bits >>= b;
+		nbits -= b;
+		return x;
+	}
+
+	std::array<std::uint32_t,256> buf {};
+	std::size_t pos {0};
+	std::size_t end {0};
+	std::size_t nfill {buf.size()};  // Words to ask of the next refill()
+	std::uint64_t ndraws {0};
+	std::uint64_t bits {0};  // For below() and uniform01()
+	int nbits {0};
+};
+
+//
+// ChaCha20 (20 rounds; 64-bit block counter, 64-bit nonce as in the original design) used as
+// a CSPRNG:  the output is the keystream for (key, stream), in order.  Keystream is made 16
+// blocks (1 KiB) at a time, 8 blocks in parallel w/ AVX2 if the cpu has it.
+//
+using chacha20_key_t = std::array<std::uint32_t,8>;
+class chacha20_engine : public pw_rng_t {
+public:
+	chacha20_engine();  // Random key from the OS, stream 0
+	chacha20_engine(const chacha20_key_t&, std::uint64_t);  // (key, stream)
+
+	static chacha20_key_t os_key();  // 256 bits from std::random_device
+	// Generates n consecutive 64-byte blocks of keystream starting at block counter ctr
+	void keystream(std::uint64_t ctr, std::size_t n, std::uint32_t *dest) const;
+	void seek(std::uint64_t) override;
+
+	bool simd {false};  // Use the AVX2 block function; set by the ctor if the cpu has AVX2
+private:
+	std::size_t refill(std::uint32_t*, std::size_t) override;
+
+	chacha20_key_t key {};
+	std::uint64_t stream {0};
+	std::uint64_t counter {0};  // Next block
+};
+
+//
+// Deterministic generator for -H:  the SHA-1 digest d of a file and seed is the key, and
+// block k of stream s is SHA1(d || s || k), s and k as 64-bit big-endian.  That message is
+// 36 bytes, so each 20 bytes of output is a single sha1_process() of a prepared block, w/
+// no sha1_finish() or context copy.  Words are the digest's 5 big-endian state words. 
+//
+using sha1_digest_t = std::array<std::uint8_t,20>;
+class sha1_engine : public pw_rng_t {
+public:
+	sha1_engine(const sha1_digest_t&, std::uint64_t);  // (d, stream)
+
+	// Block k of the stream, as the 5 words it hands out
+	void block(std::uint64_t k, std::uint32_t *dest) const;
+	void seek(std::uint64_t) override;
+private:
+	std::size_t refill(std::uint32_t*, std::size_t) override;
+
+	std::array<std::uint8_t,64> msg {};  // d || stream || counter, padded
+	std::uint64_t counter {0};  // Next block
+};
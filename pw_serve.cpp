@@ -0,0 +1,458 @@
+// pw_serve.cpp -- pwgen --serve:  passwds from pools of ready ones over a Unix domain socket
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+// Each request and each response is a frame:  a 4-byte big-endian length n, then n bytes.
+// The requests are
+//   "pw"              a passwd of the default profile (the options pwgen --serve was run with)
+//   "pw <options>"    a passwd of the profile for options, as for pwgen, e.g. "pw -sy 16"
+//   "stats"           a line per profile:  depth, passwds served, refill rate, ...
+// and a response is a status byte, '+' or '-', then the passwd, the stats or an error
+// message.  A client may send any number of requests on a connection.  Profiles are made on
+// first use, up to pw_serve_max_profiles, and can't have --seed or -H:  a daemon shares its
+// pools between clients, so their passwds must not be reproducible.  Options that make the
+// same plan share a profile.  Passwds are at most pw_serve_max_length chars, and a pool
+// holds at most pw_pool_max_bytes of them, so no request can make the daemon lock much.
+//
+
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>  // std::snprintf()
+#include <cstring>  // std::memcpy()
+#include <cerrno>
+#include "pwgen.h"
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+
+constexpr std::size_t pw_pool_step {64};  // Passwds generated per lock of the pool
+
+pw_pool_t::pw_pool_t(pw_generator_t g, std::size_t capacity)
+		: gen(std::move(g)), len(gen.opts().pw_length), cap(std::max<std::size_t>(capacity,2)) {
+	map_size = cap*len;
+#ifndef _WIN32
+	const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	map_size = (map_size + page - 1)/page*page;
+	void *p = mmap(nullptr,map_size,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+	if (p == MAP_FAILED) {
+		throw pw_error("Couldn't map a pool of " + std::to_string(map_size) + " bytes");
+	}
+	slots = static_cast<char*>(p);
+	st.locked = (mlock(slots,map_size) == 0);
+#if defined(MADV_DONTDUMP)
+	madvise(slots,map_size,MADV_DONTDUMP);
+#endif
+#else
+	slots = new char[map_size];
+#endif
+	st.capacity = cap;
+	refiller = std::thread(&pw_pool_t::refill,this);
+}
+
+pw_pool_t::~pw_pool_t() {
+	{
+		std::lock_guard<std::mutex> lk(m);
+		stop = true;
+	}
+	low.notify_one();
+	refiller.join();
+	pw_wipe(slots,map_size);
+#ifndef _WIN32
+	if (st.locked) { munlock(slots,map_size); }
+	munmap(slots,map_size);
+#else
+	delete[] slots;
+#endif
+}
+
+// The free slots from head + depth on belong to the refill thread, so it generates into
+// them w/o the lock, and only takes it to publish each step
+void pw_pool_t::refill() {
+	std::unique_lock<std::mutex> lk(m);
+	while (true) {
+		low.wait(lk,[this]() -> bool { return stop || depth <= cap/2; });
+		while (!stop && depth < cap) {
+			const std::size_t tail = (head + depth) % cap;
+			const std::size_t n = std::min({cap - depth, cap - tail, pw_pool_step});
+			lk.unlock();
+			const auto t0 = std::chrono::steady_clock::now();
+			for (std::size_t i=0; i<n; ++i) {
+				gen.next(slots + (tail + i)*len);
+			}
+			const double t = seconds_since(t0);
+			lk.lock();
+			depth += n;
+			st.refilled += n;
+			st.t_refill += t;
+			not_empty.notify_all();
+		}
+		if (stop) { return; }
+	}
+}
+
+void pw_pool_t::take(char *dest) {
+	std::unique_lock<std::mutex> lk(m);
+	if (depth == 0) {
+		++st.waits;
+		not_empty.wait(lk,[this]() -> bool { return depth > 0; });
+	}
+	char *slot = slots + head*len;
+	std::memcpy(dest,slot,len);
+	pw_wipe(slot,len);
+	head = (head + 1) % cap;
+	--depth;
+	++st.served;
+	if (depth == cap/2) {
+		low.notify_one();
+	}
+}
+
+pw_pool_stats_t pw_pool_t::stats() const {
+	std::lock_guard<std::mutex> lk(m);
+	pw_pool_stats_t s = st;
+	s.depth = depth;
+	return s;
+}
+
+
+// A pool's capacity:  pw_pool_size passwds, or fewer if they'd take over pw_pool_max_bytes
+std::size_t pw_pool_capacity(int len) {
+	return std::clamp<std::size_t>(pw_pool_max_bytes/std::max(len,1),2,pw_pool_size);
+}
+
+// The options a plan was made for, as make_pw_plan() normalized them and w/ the drop set 
+// sorted, so that "-sy" and "-ys", or "-r ab" and "-r ba", share a pool
+std::string pw_profile_key(const pw_opts_t& o) {
+	std::string drop = o.remove_chars;
+	std::sort(drop.begin(),drop.end());
+	drop.erase(std::unique(drop.begin(),drop.end()),drop.end());
+	std::string key = std::to_string(o.pw_length);
+	for (const bool b : {o.digits, o.uppers, o.symbols, o.no_vowels, o.no_ambiguous, o.random,
+			o.constructive}) {
+		key += b ? '1' : '0';
+	}
+	return key + drop;
+}
+
+// The pools by profile key, each w/ the options string that made it; "" is the default 
+// profile.  names caches the profile of each options string seen, so that a repeated 
+// request doesn't parse its options again.  
+struct pw_profiles_t {
+	struct profile_t {
+		std::string name;
+		std::unique_ptr<pw_pool_t> pool;
+	};
+	std::mutex m;
+	std::map<std::string,profile_t> pools {};
+	std::map<std::string,pw_pool_t*> names {};
+
+	void add(const std::string& name, pw_generator_t gen) {
+		const std::string key = pw_profile_key(gen.opts());
+		const std::size_t cap = pw_pool_capacity(gen.opts().pw_length);
+		auto pool = std::make_unique<pw_pool_t>(std::move(gen),cap);
+		names[name] = pool.get();
+		pools.emplace(key,profile_t {name, std::move(pool)});
+	}
+
+	pw_pool_t& get(const std::string& options) {
+		std::lock_guard<std::mutex> lk(m);
+		auto it = names.find(options);
+		if (it != names.end()) {
+			return *it->second;
+		}
+		pw_opts_t opts {};
+		run_opts_t run {};
+		parse_args(options,opts,run);
+		if (run.have_seed || run.sha1.size() > 0) {
+			throw pw_error("A profile can't have --seed or -H");
+		}
+		if (opts.pw_length > pw_serve_max_length) {
+			throw pw_error("Passwords are at most " + std::to_string(pw_serve_max_length) + " chars");
+		}
+		pw_plan_t plan = make_pw_plan(opts);
+		auto p = pools.find(pw_profile_key(plan.opts));
+		if (p != pools.end()) {
+			if (names.size() < 16*pw_serve_max_profiles) {
+				names[options] = p->second.pool.get();
+			}
+			return *p->second.pool;
+		}
+		if (pools.size() >= pw_serve_max_profiles) {
+			throw pw_error("Too many profiles (" + std::to_string(pw_serve_max_profiles) + ")");
+		}
+		add(options,pw_generator_t(std::move(plan),make_streams(run)));
+		return *names[options];
+	}
+
+	std::string stats() {
+		std::lock_guard<std::mutex> lk(m);
+		std::string s {};
+		for (const auto& [key, p] : pools) {
+			const auto ps = p.pool->stats();
+			std::array<char,512> buf {};
+			std::snprintf(buf.data(),buf.size(),
+				"\"%s\":  depth %zu/%zu, served %llu, refilled %llu at %.0f passwords/s, waits %llu%s\n",
+				p.name.c_str(), ps.depth, ps.capacity, static_cast<unsigned long long>(ps.served),
+				static_cast<unsigned long long>(ps.refilled), ps.t_refill > 0 ? ps.refilled/ps.t_refill : 0.0,
+				static_cast<unsigned long long>(ps.waits), ps.locked ? "" : " (not locked)");
+			s += buf.data();
+		}
+		return s;
+	}
+};
+
+
+#ifndef _WIN32
+
+constexpr std::uint32_t pw_serve_max_request {4096};
+
+bool read_all(int fd, char *p, std::size_t n) {
+	while (n > 0) {
+		auto nr = read(fd,p,n);
+		if (nr < 0 && errno == EINTR) { continue; }
+		if (nr <= 0) { return false; }
+		p += nr;
+		n -= static_cast<std::size_t>(nr);
+	}
+	return true;
+}
+
+bool send_all(int fd, const char *p, std::size_t n) {
+	while (n > 0) {
+#if defined(MSG_NOSIGNAL)
+		auto nw = send(fd,p,n,MSG_NOSIGNAL);
+#else
+		auto nw = send(fd,p,n,0);
+#endif
+		if (nw < 0 && errno == EINTR) { continue; }
+		if (nw <= 0) { return false; }
+		p += nw;
+		n -= static_cast<std::size_t>(nw);
+	}
+	return true;
+}
+
+bool read_frame(int fd, std::string& frame) {
+	std::array<unsigned char,4> h {};
+	if (!read_all(fd,reinterpret_cast<char*>(h.data()),h.size())) {
+		return false;
+	}
+	const std::uint32_t n = (std::uint32_t {h[0]} << 24) | (h[1] << 16) | (h[2] << 8) | h[3];
+	if (n > pw_serve_max_request) {
+		return false;
+	}
+	frame.resize(n);
+	return read_all(fd,frame.data(),n);
+}
+
+// The frame is built in place after its header, so the passwd is in one buffer to wipe
+bool send_frame(int fd, std::string& frame) {
+	const auto n = static_cast<std::uint32_t>(frame.size() - 4);
+	frame[0] = static_cast<char>(n >> 24);
+	frame[1] = static_cast<char>(n >> 16);
+	frame[2] = static_cast<char>(n >> 8);
+	frame[3] = static_cast<char>(n);
+	return send_all(fd,frame.data(),frame.size());
+}
+
+void serve_connection(int fd, pw_profiles_t& profiles) {
+	std::string req {};
+	std::string resp {};
+	while (read_frame(fd,req)) {
+		resp.assign("\0\0\0\0+",5);
+		try {
+			if (req == "stats") {
+				resp += profiles.stats();
+			} else if (req == "pw" || req.compare(0,3,"pw ") == 0) {
+				pw_pool_t& pool = profiles.get(req.size() > 3 ? req.substr(3) : "");
+				resp.resize(5 + pool.length());
+				pool.take(&resp[5]);
+			} else {
+				throw pw_error("Unknown request: " + req.substr(0,32));
+			}
+		} catch (const std::exception& e) {
+			resp.resize(4);
+			resp += '-';
+			resp += e.what();
+		}
+		const bool ok = send_frame(fd,resp);
+		pw_wipe(resp.data(),resp.size());
+		if (!ok) { break; }
+	}
+	close(fd);
+}
+
+int pw_listen(const std::string& path) {
+	sockaddr_un addr {};
+	if (path.size() >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	addr.sun_family = AF_UNIX;
+	std::memcpy(addr.sun_path,path.data(),path.size());
+	const int fd = socket(AF_UNIX,SOCK_STREAM,0);
+	if (fd < 0) {
+		return -1;
+	}
+	// A socket left behind by an earlier daemon is replaced; any other file is not
+	struct stat sb {};
+	if (lstat(path.c_str(),&sb) == 0 && S_ISSOCK(sb.st_mode)) {
+		unlink(path.c_str());
+	}
+	const mode_t old_mask = umask(0077);
+	const int err = bind(fd,reinterpret_cast<const sockaddr*>(&addr),sizeof(addr));
+	umask(old_mask);
+	if (err != 0 || listen(fd,64) != 0) {
+		const int e = errno;
+		close(fd);
+		errno = e;
+		return -1;
+	}
+	return fd;
+}
+
+void pw_serve(int fd, pw_generator_t gen) {
+	pw_ignore_sigpipe();
+	pw_profiles_t profiles {};
+	profiles.add("",std::move(gen));
+	if (!profiles.names[""]->stats().locked) {
+		std::cerr << "Warning: --serve:  couldn't lock the pools in memory (see ulimit -l)\n";
+	}
+
+	// Each connection has a thread, up to pw_serve_max_connections at once; beyond that the
+	// clients wait in the listen queue until one closes.  The pools outlive them all.
+	std::mutex m;
+	std::condition_variable done;
+	int nconn {0};
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lk(m);
+			done.wait(lk,[&nconn]() -> bool { return nconn < pw_serve_max_connections; });
+		}
+		const int c = accept(fd,nullptr,nullptr);
+		if (c < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) { continue; }
+			break;
+		}
+		{
+			std::lock_guard<std::mutex> lk(m);
+			++nconn;
+		}
+		std::thread([c,&profiles,&m,&done,&nconn]() -> void {
+			serve_connection(c,profiles);
+			std::lock_guard<std::mutex> lk(m);
+			--nconn;
+			done.notify_all();
+		}).detach();
+	}
+	std::unique_lock<std::mutex> lk(m);
+	done.wait(lk,[&nconn]() -> bool { return nconn == 0; });
+}
+
+#else
+
+int pw_listen(const std::string&) {
+	errno = ENOSYS;
+	return -1;
+}
+
+void pw_serve(int, pw_generator_t) {
+}
+
+#endif
+
+
+#if defined(TEST)
+
+#include <cstdio>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+//
+// 1) A pool hands out its generator's passwds in order:  a seeded pool against next().
+// 2) A server on a socket in /tmp:  passwds of the default profile and of another (which
+//    the same options in another order share), the stats, and the errors (also for an
+//    overlong passwd), over one connection; then a shutdown() of the socket ends it.
+//
+bool request(int fd, const std::string& req, std::string& resp) {
+	std::string frame(4,'\0');
+	frame += req;
+	return send_frame(fd,frame) && read_frame(fd,resp);
+}
+
+int main() {
+	int nfail {0};
+	printf( "\n Pool and server Tests:\n\n" );
+
+	pw_opts_t opts {};
+	opts.pw_length = 12;
+	const pw_streams_t streams {chacha20_key_t {5}, 0, 1, false, {}, true};
+	pw_generator_t ref(make_pw_plan(opts),streams);
+	bool ok {true};
+	{
+		pw_pool_t pool(pw_generator_t(make_pw_plan(opts),streams),100);
+		std::string pw(12,'\0');
+		for (int i=0; i<1000; ++i) {
+			pool.take(pw.data());
+			ok = ok && pw == ref.next();
+		}
+		const auto ps = pool.stats();
+		ok = ok && ps.served == 1000 && ps.refilled >= 1000 && ps.capacity == 100;
+	}
+	printf( " Test 1 (pool order) %s\n", ok ? "passed." : "failed!" );
+	nfail += ok ? 0 : 1;
+
+	const std::string path = "/tmp/pwgen_serve_test." + std::to_string(getpid());
+	const int fd = pw_listen(path);
+	if (fd < 0) {
+		std::perror(" Test 2 (listen)");
+		return 1;
+	}
+	std::thread server(pw_serve,fd,pw_generator_t(make_pw_plan(opts),pw_streams_t {chacha20_engine::os_key()}));
+	const int c = socket(AF_UNIX,SOCK_STREAM,0);
+	sockaddr_un addr {};
+	addr.sun_family = AF_UNIX;
+	std::memcpy(addr.sun_path,path.data(),path.size());
+	ok = connect(c,reinterpret_cast<const sockaddr*>(&addr),sizeof(addr)) == 0;
+	struct stat sb {};
+	ok = ok && lstat(path.c_str(),&sb) == 0 && (sb.st_mode & 0077) == 0;
+	std::string a {}, b {}, y {}, y2 {}, s {}, e1 {}, e2 {}, e3 {};
+	ok = ok && request(c,"pw",a) && request(c,"pw",b) && request(c,"pw -sy 20",y);
+	ok = ok && request(c,"pw -y -s 20",y2) && request(c,"pw 100000000",e3);
+	ok = ok && request(c,"stats",s) && request(c,"pw --seed=1",e1) && request(c,"frobnicate",e2);
+	ok = ok && a.size() == 13 && a[0] == '+' && b.size() == 13 && a != b;
+	ok = ok && y.size() == 21 && y[0] == '+' && y.find_first_of("!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~",1) != std::string::npos;
+	ok = ok && s[0] == '+' && s.find("\"\":  depth") != std::string::npos && s.find("\"-sy 20\":") != std::string::npos;
+	ok = ok && y2.size() == 21 && y2[0] == '+' && s.find("\"-y -s 20\":") == std::string::npos;
+	ok = ok && e1[0] == '-' && e2[0] == '-' && e3[0] == '-';
+	printf( " Test 2 (server) %s\n", ok ? "passed." : "failed!" );
+	printf( "%s", s.c_str()+1 );
+	nfail += ok ? 0 : 1;
+	close(c);
+	shutdown(fd,SHUT_RDWR);
+	server.join();
+	close(fd);
+	unlink(path.c_str());
+	printf( "\n" );
+
+	return nfail == 0 ? 0 : 1;
+}
+
+#endif
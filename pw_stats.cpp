@@ -0,0 +1,60 @@
+// pw_stats.cpp -- counters of a pwgen run and their summary
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+
+#include <string>
+#include <array>
+#include <cstdint>
+#include <cstdio>  // std::snprintf()
+#include "pwgen.h"
+
+
+pw_stats_t& operator+=(pw_stats_t& a, const pw_stats_t& b) {
+	a.npw += b.npw;
+	a.titer += b.titer;
+	a.nclears += b.nclears;
+	a.nfail.upper += b.nfail.upper;
+	a.nfail.digit += b.nfail.digit;
+	a.nfail.symbol += b.nfail.symbol;
+	a.nfail.length += b.nfail.length;
+	a.ndraws += b.ndraws;
+	a.nduplicates += b.nduplicates;
+	a.t_plan += b.t_plan;
+	a.t_generate += b.t_generate;
+	a.t_output += b.t_output;
+	return a;
+}
+
+// The per-passwd rates are 0 for a run of 0 passwds
+std::string format_stats(const pw_stats_t& st, bool json) {
+	const double npw = st.npw > 0 ? static_cast<double>(st.npw) : 1.0;
+	const auto ull = [](std::uint64_t x) -> unsigned long long { return x; };
+	std::array<char,512> buf {};
+	if (json) {
+		std::snprintf(buf.data(),buf.size(),
+			"{\"passwords\":%llu,\"titer\":%llu,\"nclears\":%llu,"
+			"\"nfail\":{\"upper\":%llu,\"digit\":%llu,\"symbol\":%llu,\"length\":%llu},"
+			"\"rng_words\":%llu,\"duplicates\":%llu,"
+			"\"per_password\":{\"titer\":%.4f,\"retries\":%.4f,\"rng_words\":%.4f},"
+			"\"seconds\":{\"plan\":%.6f,\"generate\":%.6f,\"output\":%.6f}}\n",
+			ull(st.npw), ull(st.titer), ull(st.nclears),
+			ull(st.nfail.upper), ull(st.nfail.digit), ull(st.nfail.symbol), ull(st.nfail.length),
+			ull(st.ndraws), ull(st.nduplicates), st.titer/npw, st.nclears/npw, st.ndraws/npw,
+			st.t_plan, st.t_generate, st.t_output);
+		return std::string(buf.data());
+	}
+
+	std::snprintf(buf.data(),buf.size(),
+		"passwords            %llu\n"
+		"steps / password     %.4f\n"
+		"retries / password   %.4f  (missing upper %llu, digit %llu, symbol %llu; overshoot %llu)\n"
+		"rng words / password %.4f\n"
+		"duplicates           %llu\n"
+		"time (ms)            plan %.3f, generate %.3f (%.1f ns/password), output %.3f\n",
+		ull(st.npw), st.titer/npw, st.nclears/npw,
+		ull(st.nfail.upper), ull(st.nfail.digit), ull(st.nfail.symbol), ull(st.nfail.length),
+		st.ndraws/npw, ull(st.nduplicates), 1e3*st.t_plan, 1e3*st.t_generate, 1e9*st.t_generate/npw, 1e3*st.t_output);
+	return std::string(buf.data());
+}
+
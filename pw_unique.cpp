@@ -0,0 +1,142 @@
+// pw_unique.cpp -- the set of passwds already generated, for --unique
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>  // std::memcpy()
+#include "pwgen.h"
+
+
+pw_unique_set_t::pw_unique_set_t(std::size_t n) {
+	std::size_t cap {16};
+	while (cap < 2*n) { cap *= 2; }
+	slots = std::vector<std::atomic<std::uint64_t>>(cap);
+	mask = cap - 1;
+	const auto k = chacha20_engine::os_key();
+	key = {(std::uint64_t {k[0]} << 32) | k[1], (std::uint64_t {k[2]} << 32) | k[3]};
+}
+
+inline std::uint64_t mix64(std::uint64_t x) {
+	x ^= x >> 32;
+	x *= 0xd6e8feb86659fd93ull;
+	x ^= x >> 32;
+	x *= 0xd6e8feb86659fd93ull;
+	x ^= x >> 32;
+	return x;
+}
+
+// The passwd 8 bytes at a time, keyed at both ends; never 0
+std::uint64_t pw_unique_set_t::fingerprint(std::string_view pw) const {
+	std::uint64_t h = key[0] ^ (pw.size()*0x9e3779b97f4a7c15ull);
+	for (std::size_t i=0; i<pw.size(); i += 8) {
+		std::uint64_t w {0};
+		std::memcpy(&w,pw.data()+i,std::min<std::size_t>(8,pw.size()-i));
+		h = mix64(h ^ w);
+	}
+	h = mix64(h ^ key[1]);
+	return h != 0 ? h : 1;
+}
+
+// A slot only ever goes from 0 to a fingerprint, so a thread that loses the CAS for an
+// empty slot just compares against the winner's fingerprint and probes on.  Nothing else
+// is published through the slots, so relaxed ordering is enough.
+bool pw_unique_set_t::insert(std::string_view pw) {
+	const std::uint64_t fp = fingerprint(pw);
+	for (std::uint64_t i=fp & mask; ; i=(i+1) & mask) {
+		std::uint64_t cur = slots[i].load(std::memory_order_relaxed);
+		if (cur == 0 && slots[i].compare_exchange_strong(cur,fp,std::memory_order_relaxed)) {
+			return true;
+		}
+		if (cur == fp) {
+			return false;
+		}
+	}
+}
+
+
+#if defined(TEST)
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+//
+// 8 threads insert overlapping ranges of 200000 keys each (every key by 2 threads, in
+// opposite orders):  each key must be taken exactly once, and the total must be the
+// number of distinct keys.  Then a batch of 3 unique passwds from a keyspace of 2 throws a
+// pw_error rather than exiting.
+//
+int main() {
+	int nfail {0};
+	printf( "\n Unique set Tests:\n\n" );
+
+	constexpr int nkeys {800000};
+	constexpr int nthreads {8};
+	pw_unique_set_t set(nkeys);
+	std::vector<std::atomic<int>> taken(nkeys);
+	auto work = [&set,&taken](int t) -> void {
+		const int lo = (t/2)*(nkeys/4);
+		for (int j=0; j<nkeys/4; ++j) {
+			const int k = lo + ((t % 2) ? j : nkeys/4-1-j);
+			const std::string pw = "pw" + std::to_string(k);
+			if (set.insert(pw)) { ++taken[k]; }
+		}
+	};
+	std::vector<std::thread> workers {};
+	for (int t=0; t<nthreads; ++t) {
+		workers.emplace_back(work,t);
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+	int nonce {0};
+	for (const auto& x : taken) {
+		nonce += (x == 1);
+	}
+	printf( " Test 1 (concurrent inserts) " );
+	if (nonce != nkeys) {
+		printf( "failed!  %d of %d keys taken once\n", nonce, nkeys );
+		++nfail;
+	} else {
+		printf( "passed.\n" );
+	}
+
+	printf( " Test 2 (reinsert) " );
+	bool ok {true};
+	for (int k=0; k<nkeys; k += 997) {
+		ok = ok && !set.insert("pw" + std::to_string(k));
+	}
+	ok = ok && set.insert("not a key") && !set.insert("not a key");
+	printf( ok ? "passed.\n" : "failed!\n" );
+	nfail += ok ? 0 : 1;
+
+	printf( " Test 3 (exhausted keyspace) " );
+	pw_opts_t opts {};
+	opts.random = true;
+	opts.digits = false;
+	opts.uppers = false;
+	opts.pw_length = 1;
+	opts.remove_chars = "cdefghijklmnopqrstuvwxyz";
+	pw_unique_set_t small(3);
+	pw_batch_t batch {};
+	ok = false;
+	try {
+		generate_batch(make_pw_plan(opts),3,batch,pw_streams_t {chacha20_key_t {7}, 0, 2},
+			nullptr,&small);
+	} catch (const pw_error&) {
+		ok = true;
+	}
+	printf( ok ? "passed.\n" : "failed!\n" );
+	nfail += ok ? 0 : 1;
+	printf( "\n" );
+
+	return nfail == 0 ? 0 : 1;
+}
+
+#endif
@@ -8,116 +8,147 @@
 #include <string>
 #include <algorithm>  // std::max()
 #include <exception>
-#include <random>
+#include <cstdint>
+#include <vector>
+#include <cstdio>  // std::perror()
+#include <chrono>
+#include <memory>
+#include <cmath>
+#include <cerrno>
+#include <utility>  // std::move()
 
-std::random_device g_srd {};
-std::mt19937 g_re(g_srd());
+int run_pwgen(pw_opts_t&, const run_opts_t&);
 
 int main(int argc, char **argv) {
-	//stats();
-	//test_sample_if(g_re);
-
-	int	term_width = 80;
-	const char *pw_options = "01AaBCcnN:sr:hH:vy";
-
-	auto x = {1,2};
-
-	//if (isatty(1)) { do_columns = 1; }
-	//optflag pwgen_flags {optflag::require_digits | optflag::require_uppers};
-
 	pw_opts_t opts {};
-	// Parse cmd ln:
-	// 1)  Set pw_opts (pwgen_flags); includes do_columns, pw_number, num_pw,
-	//     char* remove (opts.remove_chars for opt 'r')
-	// 2)  Set pwgen == pw_rand (opt v, r, s)
-	//     Default pwgen == pw_phonemes
-	// 3)  Set pw_number; opt H => pw_number == pw_sha1_number(); pw_sha1_init() opt H
-	//     Default pw_number == pw_random_number
-	// 4)  Call usage() if unrecognized arg
-
-	if (opts.pw_length < 5) {
-		opts.random = true;
+	run_opts_t run {};
+	try {
+		parse_args(argc,argv,opts,run);
+	} catch (const pw_error& e) {
+		std::cerr << e.what() << "\n" << usage();
+		return -1;
 	}
-	if (!opts.random) {
-		if (opts.pw_length <= 2) { opts.uppers = false; }  // pwgen_flags &= ~PW_UPPERS;
-		if (opts.pw_length <= 1) { opts.digits = false; }  // pwgen_flags &= ~PW_DIGITS;
-		// Not sure why not allowed to have uppers in 2-char pw's, or digits in 1-char pw's.
-		// Do i not understand this correctly?
+	if (run.help) {
+		std::cout << usage();
+		return 0;
 	}
-	if (opts.pw_length <= 0) {
-		std::cerr << "Invalid password length.  \n" << std::endl;
+	try {
+		return run_pwgen(opts,run);
+	} catch (const pw_error& e) {
+		std::cerr << "Error: " << e.what() << "\n" << std::endl;
 		return -1;
 	}
-	if (opts.num_pw <= 0) {
+}
+
+// pwgen as a client of the library:  the plan and the streams, then a pw_generator_t's 
+// batches into a writer
+int run_pwgen(pw_opts_t& opts, const run_opts_t& run) {
+	if (opts.num_pw < 0) {
 		std::cerr << "Invalid number of passwords.  \n" << std::endl;
 		return -1;
 	}
-	if (opts.cols) {
-		if (opts.num_cols <= 0) {
-			std::cerr << "Invalid number of columns.  \n" << std::endl;
+	const bool stream = (run.stream || opts.num_pw == 0);
+	if (stream && run.unique) {
+		std::cerr << "Error: --unique needs a number of passwords (no --stream)\n" << std::endl;
+		return -1;
+	}
+
+	pw_stats_t stats {};
+	pw_stats_t *pstats = (run.stats || run.unique) ? &stats : nullptr;
+	const auto t_plan = std::chrono::steady_clock::now();
+	pw_plan_t plan = make_pw_plan(opts);
+	stats.t_plan = seconds_since(t_plan);
+	if (run.dump_phonemes) {
+		if (plan.opts.random) {
+			std::cerr << "Error: --dump-phonemes needs a phoneme password (no -s)\n" << std::endl;
+			return -1;
+		}
+		std::cout << dump_phoneme_automaton(plan.phonemes);
+		return 0;
+	}
+	if (run.entropy) {
+		std::cout << format_entropy(pw_entropy(plan));
+		return 0;
+	}
+	// Only now:  w/ -H this hashes the whole file
+	const pw_streams_t streams = make_streams(run);
+	pw_ignore_sigpipe();
+	if (run.serve.size() > 0) {
+		const int fd = pw_listen(run.serve);
+		if (fd < 0) {
+			std::perror(("pwgen: " + run.serve).c_str());
 			return -1;
 		}
-		opts.num_cols = std::max(term_width/(opts.pw_length+1),1);
+		std::cerr << "pwgen: serving on " << run.serve << "\n";
+		pw_serve(fd,pw_generator_t(std::move(plan),streams));
+		return 0;
 	}
-	//if (num_pw < 0) {num_pw = do_columns ? num_cols * 20 : 1; }
-	
 
-	std::string curr_passwd {};
-	for (int i=0; i < opts.num_pw; ++i) {
-		if (!opts.random) {
-			curr_passwd = pw_phonemes(opts,g_re);
-		} else {
-			curr_passwd = pw_rand(opts);
+	int out_fd {1};
+	if (run.output.size() > 0) {
+		out_fd = pw_open_output(run.output);
+		if (out_fd < 0) {
+			std::cerr << "Couldn't open file: " << run.output << "\n" << std::endl;
+			return -1;
 		}
+	}
+	if (!run.cols_set) {
+		opts.cols = pw_is_tty(out_fd);
+	}
+	opts.num_cols = opts.cols ? pw_num_cols(pw_term_width(out_fd),opts.pw_length) : 1;
 
-		std::cout << curr_passwd;
-		if (i > 0 && i%opts.num_cols==0) {
-			std::cout << "\n";
-		} else {
-			std::cout << "\t";
+	// The number of passwds is exact; for phonemes the likelier ones collide sooner than 
+	// that suggests, so the warning goes by the lower bound on the entropy
+	std::unique_ptr<pw_unique_set_t> unique {};
+	if (run.unique) {
+		const pw_entropy_t e = pw_entropy(plan);
+		const double bits = e.shannon_lower;
+		if (opts.num_pw > pw_npasswds(e)) {
+			std::cerr << "Error: --unique:  only " << static_cast<long long>(pw_npasswds(e))  // < num_pw
+				<< " different passwords exist for these options\n" << std::endl;
+			return -1;
 		}
+		if (opts.num_pw > std::exp2(bits)/16) {
+			std::cerr << "Warning: --unique:  " << opts.num_pw << " passwords is close to the "
+				<< "effective keyspace (about 2^" << std::floor(10*bits)/10 << "); expect many redraws\n";
+		}
+		unique = std::make_unique<pw_unique_set_t>(opts.num_pw);
+	}
 
-		/*if (!opts.cols || ((i % opts.num_cols)==(opts.num_cols-1)) || (i==(opts.num_pw-1))) {
-			std::cout << curr_passwd << "\n";
-		} else {
-			std::cout << curr_passwd << "\n";
-		}*/
+	// Each batch is a whole number of chunks (see generate_batch()), so that the output for 
+	// a given key is the same for any --threads.  The batch and the writer's buffer are 
+	// reused, so a --stream run holds the same memory however long it runs, and blocks in 
+	// write(2) whenever the reader falls behind.  
+	const std::size_t batch_size = pw_chunk_size*16*streams.nthreads;
+	pw_generator_t gen(std::move(plan),streams);
+	pw_batch_t batch {};
+	pw_writer_t out = make_writer(out_fd,opts.num_cols);
+	int werr {0};  // errno of a failed write
+	const auto num_pw = static_cast<std::uint64_t>(opts.num_pw);
+	for (std::uint64_t i=0; werr == 0 && (stream || i < num_pw); i += batch.size()) {
+		const std::size_t n = stream ? batch_size : std::min<std::uint64_t>(num_pw-i,batch_size);
+		gen.fill_batch(n,batch,pstats,unique.get());
+		const auto t_out = std::chrono::steady_clock::now();
+		if (!write_batch(out,batch)) { werr = errno; }
+		stats.t_output += seconds_since(t_out);
+	}
+	const auto t_out = std::chrono::steady_clock::now();
+	if (werr == 0 && !finish_writer(out)) { werr = errno; }
+	stats.t_output += seconds_since(t_out);
+	// A reader that goes away (pwgen --stream | head) ends the run normally
+	if (werr != 0 && werr != EPIPE) {
+		errno = werr;
+		std::perror("pwgen: write");
+		return -1;
 	}
 
+	if (run.unique && !run.stats) {
+		std::cerr << "pwgen: --unique:  " << stats.nduplicates << " duplicates redrawn ("
+			<< 100.0*stats.nduplicates/(stats.npw + stats.nduplicates) << "% of draws)\n";
+	}
+	if (run.stats) {
+		std::cerr << format_stats(stats,run.stats_json);
+	}
 	return 0;
 }
 
-
-std::string usage() {
-	std::string s {};
-
-	s += "Usage: pwgen [ OPTIONS ] [ pw_length ] [ num_pw ]\n\n";
-	s += "Options supported by pwgen:\n";
-	s += "  -c or --capitalize\n";
-	s += "\tInclude at least one capital letter in the password\n";
-	s += "  -A or --no-capitalize\n";
-	s += "\tDon't include capital letters in the password\n";
-	s += "  -n or --numerals\n";
-	s += "\tInclude at least one number in the password\n";
-	s += "  -0 or --no-numerals\n";
-	s += "\tDon't include numbers in the password\n";
-	s += "  -y or --symbols\n";
-	s += "\tInclude at least one special symbol in the password\n";
-	s += "  -r <chars> or --remove-chars=<chars>\n";
-	s += "\tRemove characters from the set of characters to generate passwords\n";
-	s += "  -s or --secure\n";
-	s += "\tGenerate completely random passwords\n";
-	s += "  -B or --ambiguous\n";
-	s += "\tDon't include ambiguous characters in the password\n";
-	s += "  -h or --help\n";
-	s += "\tPrint a help message\n";
-	s += "  -H or --sha1=path/to/file[#seed]\n";
-	s += "\tUse sha1 hash of given file as a (not so) random generator\n";
-	s += "  -C\n\tPrint the generated passwords in columns\n";
-	s += "  -1\n\tDon't print the generated passwords in columns\n";
-	s += "  -v or --no-vowels\n";
-	s += "\tDo not use any vowels so as to avoid accidental nasty words\n";
-	
-	return s;
-}
-
@@ -7,6 +7,25 @@
 #include <string>
 #include <random>
 #include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <string_view>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "pw_rng.h"
+
+// Invalid options, or an option set that allows no passwds:  thrown by make_pw_plan(), 
+// parse_args() and make_streams(), where the C version printed a message and exited.  
+struct pw_error : std::runtime_error {
+	using std::runtime_error::runtime_error;
+};
 
 // std::sample(elements.begin(),elements.end(),&curr_elem,1,re);
 template<typename It_src, typename It_dest, typename Reng, typename Pred>
@@ -19,26 +38,66 @@ bool sample_if(It_src beg, It_src end, It_dest dest, Reng&& re, Pred p) {
 	//*dest=element;
 	return true;
 };
-int test_sample_if(std::mt19937&);
 
 enum eflag {
 	vowel = 0x0001,  
 	dipthong = 0x0004,
 	first = 0x0008  // element is allowed to appear first
 };
-constexpr bool is_consonant(int);  // => !is_vowel()
-constexpr bool is_vowel(int);  // => !is_consonant()
-constexpr bool is_dipthong(int);  // => !is_consonant()
-constexpr bool is_vowel_and_dipth(int);
-constexpr bool may_appear_first(int);
+constexpr bool is_consonant(int ef) {  // => !is_vowel()
+	return !(ef & eflag::vowel);
+}
+constexpr bool is_vowel(int ef) {  // => !is_consonant()
+	return (ef & eflag::vowel);
+}
+constexpr bool is_dipthong(int ef) {  // => !is_consonant()
+	return (ef & eflag::dipthong);
+}
+constexpr bool is_vowel_and_dipth(int ef) {
+	return ((ef & eflag::vowel) && (ef & eflag::dipthong));
+}
+constexpr bool is_single_vowel(int ef) {
+	return (is_vowel(ef) && !is_dipthong(ef));
+}
+constexpr bool may_appear_first(int ef) {
+	return (ef & eflag::first);
+}
+constexpr bool is_first_consonant(int ef) {
+	return (may_appear_first(ef) && is_consonant(ef));
+}
 bool is_digit(char);
-bool debug_sanity_check_eflag_conditions(int);
-int stats();
+constexpr bool debug_sanity_check_eflag_conditions(int ef) {
+	if (is_vowel(ef) && is_consonant(ef)) {
+		return false;
+	}
+
+	if (is_vowel_and_dipth(ef) && is_consonant(ef)) {
+		return false;
+	}
+
+	if (is_vowel_and_dipth(ef) && !is_vowel(ef)) {
+		return false;
+	}
 
+	return true;
+}
+
+// One or two chars stored inline (not '\0' terminated) + a length byte; trivially 
+// copyable, so that the element table is constexpr and picks copy 5 bytes.  weight scales 
+// the element's share of every state it may appear in (1 => the classic pwgen odds).  
 struct pw_element {
-	std::string str {};  // TODO:  std::array<char,2>; insane to make this a std::string
-	int flags {0};
+	char str[2] {};
+	std::uint8_t len {0};
+	std::uint8_t flags {0};
+	std::uint8_t weight {1};
 };
+template<std::size_t N>
+constexpr pw_element make_element(const char (&s)[N], int flags, int weight = 1) {
+	static_assert(N==2 || N==3, "An element is one or two chars");
+	return pw_element {{s[0], (N==3 ? s[1] : '\0')},
+		static_cast<std::uint8_t>(N-1), static_cast<std::uint8_t>(flags), 
+		static_cast<std::uint8_t>(weight)};
+}
 
 struct pw_opts_t {
 	bool digits {true};  // True => at least one digit
@@ -48,15 +107,409 @@ struct pw_opts_t {
 	bool no_ambiguous {false};  // "Don't include ambiguous characters":  -B | --ambiguos
 	bool random {false};  // "generate completely random passwords -s | --secure"
 		// use pwgen = pw_rand
+	bool constructive {false};  // pw_rand() w/o the retry loop:  --constructive
 	bool cols {true};  // output in cols:  -C
 	int num_cols {5};
-	int num_pw {100};  // number of pw's to generate
+	int num_pw {100};  // number of pw's to generate; 0 => --stream
 	int pw_length {10};
 	std::string remove_chars {};
 };
-std::string pw_phonemes(const pw_opts_t&, std::mt19937&);
-std::string pw_rand(const pw_opts_t&);
 
+// Counters of a run, summed over every passwd and thread.  Pass a pw_stats_t* to the 
+// generators to have them add to it; nullptr (the default) counts nothing.  
+struct pw_stats_t {
+	std::uint64_t npw {0};  // Passwds generated
+	std::uint64_t titer {0};  // pw_phonemes() steps; pw_rand() draws of a whole passwd
+	std::uint64_t nclears {0};  // Passwds thrown away and redrawn
+	struct nfail_t {  // nclears by cause; a passwd missing 2 classes counts under both
+		std::uint64_t upper {0};
+		std::uint64_t digit {0};
+		std::uint64_t symbol {0};
+		std::uint64_t length {0};  // Overshoot; the length-aware pw_phonemes() never does
+	};
+	nfail_t nfail {};
+	std::uint64_t ndraws {0};  // 32-bit words drawn from the RNG
+	std::uint64_t nduplicates {0};  // --unique:  passwds redrawn because they were already out
+
+	// Wall time (s) of each phase:  make_pw_plan(), generate_batch(), writing the output
+	double t_plan {0.0};
+	double t_generate {0.0};
+	double t_output {0.0};
+};
+pw_stats_t& operator+=(pw_stats_t&, const pw_stats_t&);
+std::string format_stats(const pw_stats_t&, bool json);  // Summary; json => a single JSON object
+double seconds_since(std::chrono::steady_clock::time_point);
+
+// Char classes a passwd can be required to include
+enum cflag {
+	digit = 0x01,
+	upper = 0x02,
+	symbol = 0x04
+};
+
+// States of the phoneme automaton:  nothing emitted yet, or the last element emitted was a 
+// consonant or a vowel.  
+enum pstate {
+	st_start = 0,
+	st_consonant = 1,
+	st_vowel = 2
+};
+// One transition of the phoneme automaton:  a whole step of pw_phonemes(), i.e. an element 
+// (possibly uppercased), optionally preceded by a digit and/or a symbol.  A transition w/ a 
+// digit or symbol stands for one sub-outcome per digit/symbol char, each of weight unit; 
+// the transition's draws are [first, first + unit*nsub).  
+struct pw_transition_t {
+	std::uint32_t first {0};
+	std::uint32_t unit {0};
+	std::uint32_t span {0};  // Alias draws per sub-outcome; see pw_alias_t
+	pw_element text {};  // The element as emitted
+	std::uint8_t features {0};  // cflag bits:  the step has a digit, symbol, or uppercased elem
+	std::uint8_t next {st_start};  // pstate after the step
+};
+// The transitions of a state w/ the same length, next state and features are contiguous in 
+// trans[], in draws [first, first + weight).  A transition of the group is then picked from 
+// its alias table:  ntrans columns of height each, at alias[s][col].  
+struct pw_tgroup_t {
+	std::uint32_t first {0};
+	std::uint32_t weight {0};
+	std::uint32_t col {0};
+	std::uint32_t height {0};
+	std::uint16_t ntrans {0};
+	std::uint8_t len {0};  // Chars emitted
+	std::uint8_t next {st_start};
+	std::uint8_t features {0};
+};
+// A column of a group's alias table (Vose), in integers:  a draw y < height of the column 
+// is transition own if y < cut, else transition alias.  Each transition t of the group has 
+// ntrans*(its weight)/gcd draws over all the columns, laid end to end from own_pos and 
+// alias_pos in the columns that hold it; sub-outcome k of t is those in [k, k+1)*t.span.  
+struct pw_alias_t {
+	std::uint32_t cut {0};
+	std::uint16_t own {0};  // Indices into trans[s]
+	std::uint16_t alias {0};
+	std::uint32_t own_pos {0};
+	std::uint32_t alias_pos {0};
+};
+
+// Candidate tables for pw_phonemes(), built once per option set by make_phoneme_tables().  
+// Each table holds indices into elements[] of the elements allowed in that state, 
+// already filtered against opts.no_vowels, opts.no_ambiguous and opts.remove_chars.  These 
+// are then compiled into the automaton trans[], so that each step is a single weighted draw.  
+struct phoneme_tables_t {
+	std::vector<int> first {};  // Start of a word
+	std::vector<int> after_consonant {};
+	std::vector<int> after_vowel {};  // Weighted by repetition; see make_phoneme_tables()
+	std::vector<bool> may_upper {};  // Indexed like elements[]
+	std::string digits {};
+	std::string symbols {};
+
+	std::array<std::vector<pw_transition_t>,3> trans {};  // Indexed by pstate; by first
+	std::array<std::vector<pw_tgroup_t>,3> groups {};
+	std::array<std::uint32_t,3> total {};  // Sum of the weights of trans[s]
+	std::array<std::vector<pw_alias_t>,3> alias {};  // The groups' alias tables, by col
+
+	// Completion table for pw_length:  ncomplete[(r*3 + s)*8 + m] is the probability that a 
+	// walk from state s emits exactly r more chars and includes the cflag bits m.  
+	int pw_length {0};
+	std::vector<double> ncomplete {};
+	// group_cum[s][(r*8 + m)*groups[s].size() + j]:  the sum of the weights of groups 0..j of 
+	// state s, each times the ncomplete[] of where it leads, w/ r chars left and m missing
+	std::array<std::vector<double>,3> group_cum {};
+	std::uint8_t required {0};  // cflag bits every passwd must include
+};
+phoneme_tables_t make_phoneme_tables(const pw_opts_t&);
+std::string dump_phoneme_automaton(const phoneme_tables_t&);
+void pw_phonemes(const pw_opts_t&, const phoneme_tables_t&, pw_rng_t&, char*, 
+					pw_stats_t* = nullptr);
+std::string pw_phonemes(const pw_opts_t&, const phoneme_tables_t&, pw_rng_t&);
+
+// The charset for pw_rand(), built and validated once per option set by make_charset_plan().  
+// Per-passwd work in pw_rand() is then only random draws, writes, and a table lookup per 
+// char to record which classes the passwd contains.  
+constexpr int pw_constructive_max_length {1024};
+struct charset_plan_t {
+	std::string chars {};  // lowers + the classes requested by opts, less any dropped chars
+	std::array<std::uint8_t,256> cls {};  // cflag bits of each char in chars
+	std::uint8_t required {0};  // cflag bits every passwd must include
+	int pw_length {0};
+
+	// For the SIMD kernel, which maps random bytes straight to chars:  lut[b] == 
+	// chars[b % chars.size()] for b < limit, the largest multiple of chars.size() <= 256; 
+	// bytes >= limit are redrawn, so each char is exactly uniform, as in the scalar path.  
+	std::array<char,256> lut {};
+	int limit {0};
+	// Set by make_charset_plan() if the cpu supports the SIMD kernel.  The kernel draws whole 
+	// bytes where the scalar one draws below(), so the same stream gives other passwds on 
+	// other cpus:  clear it where a stream must give the same passwds everywhere (--seed, -H).  
+	bool simd {false};
+
+	// For opts.constructive:  chars holds the lowers, digits, uppers and symbols in that order, 
+	// class_size[k] of each.  ncover[8*r+m] is the number of length-r strings over chars 
+	// containing every class in the cflag set m, as little-endian 32-bit limbs.  The table 
+	// takes space and time quadratic in pw_length, hence pw_constructive_max_length.  
+	bool constructive {false};
+	std::array<int,4> class_size {};
+	std::vector<std::vector<std::uint32_t>> ncover {};
+};
+charset_plan_t make_charset_plan(const pw_opts_t&);
+void pw_rand(const charset_plan_t&, pw_rng_t&, char*, pw_stats_t* = nullptr);
+std::string pw_rand(const charset_plan_t&, pw_rng_t&);
+
+// Everything needed to generate passwds for one option set; only the tables for the 
+// generator selected by opts.random are built.  
+struct pw_plan_t {
+	pw_opts_t opts {};
+	phoneme_tables_t phonemes {};
+	charset_plan_t charset {};
+};
+pw_plan_t make_pw_plan(const pw_opts_t&);
+void pw_generate(const pw_plan_t&, pw_rng_t&, char*, pw_stats_t* = nullptr);  // opts.pw_length chars
+
+// The Shannon entropy and min-entropy (bits) of the passwds of a plan, and their number, for 
+// --entropy and --unique.  For pw_rand() they are exact.  For pw_phonemes() the entropies are 
+// bounded:  from above by the automaton's walks', from below by the collision entropy of 
+// the passwds (and a bound on the likeliest one); see pw_entropy.cpp.  
+struct pw_entropy_t {
+	double shannon {0.0};  // Upper bounds if !exact
+	double min {0.0};
+	double shannon_lower {0.0};  // == shannon and min if exact
+	double min_lower {0.0};
+	double log2_npasswds {0.0};  // Of the distinct passwds, which may be far more than 2^1024
+	bool exact {true};
+};
+pw_entropy_t pw_entropy(const pw_plan_t&);
+double pw_npasswds(const pw_entropy_t&);  // The number itself, exact below 2^40; else 2^40
+std::string format_entropy(const pw_entropy_t&);
+
+// N passwds stored back to back (no separators or '\0') in a single arena; passwd i is 
+// chars[offsets[i], offsets[i+1]).  generate_batch() replaces the contents but keeps the 
+// capacity, so a reused batch costs no allocations.  
+struct pw_batch_t {
+	std::vector<char> chars {};
+	std::vector<std::size_t> offsets {0};
+
+	std::size_t size() const;
+	std::string_view operator[](std::size_t) const;
+	void clear();
+};
+void generate_batch(const pw_plan_t&, std::size_t, pw_batch_t&, pw_rng_t&, pw_stats_t* = nullptr);
+void generate_batch(const pw_opts_t&, std::size_t, pw_batch_t&, pw_rng_t&, pw_stats_t* = nullptr);
+void pw_wipe(void*, std::size_t);  // Zeroes memory that held passwds; never optimized away
+
+// Multi-threaded generation.  The passwds of a run are numbered in chunks of pw_chunk_size, 
+// and chunk k draws from ChaCha20 stream k under the run's key, so the streams never 
+// overlap.  Each thread fills a disjoint, contiguous range of chunks, so the output for a 
+// given key is the same for any nthreads.  
+//
+// Seekable runs (--seed, -H) give each passwd a stream of its own instead:  passwd i is 
+// drawn from the start of stream i, so it is a function of (key, i) alone and any range of 
+// a run can be regenerated w/o the passwds before it.  
+constexpr std::size_t pw_chunk_size {1024};
+constexpr int pw_max_threads {256};  // --threads, at most; pwgen's batches grow w/ the threads
+struct pw_streams_t {
+	chacha20_key_t key {};
+	std::uint64_t first {0};  // Index of the first passwd of the batch; chunk aligned unless seekable
+	int nthreads {1};
+	bool sha1 {false};  // -H:  draw from sha1_engine streams under digest instead
+	sha1_digest_t digest {};
+	bool seekable {false};  // Stream per passwd rather than per chunk
+};
+
+// The passwds already out, for --unique:  a lock-free open-addressing set of keyed 64-bit 
+// fingerprints (0 == empty slot), linear probing, sized once for at most half full.  
+// Two different passwds w/ the same fingerprint count as equal, so w/ n passwds in the 
+// set about n*n/2^65 of them are redrawn needlessly.  
+class pw_unique_set_t {
+public:
+	explicit pw_unique_set_t(std::size_t n);  // Room for n passwds
+	bool insert(std::string_view);  // false => already in the set
+	std::size_t capacity() const { return slots.size(); }
+private:
+	std::uint64_t fingerprint(std::string_view) const;
+
+	std::vector<std::atomic<std::uint64_t>> slots;
+	std::uint64_t mask {0};
+	std::array<std::uint64_t,2> key {};
+};
+constexpr int pw_unique_max_tries {1000000};  // Redraws of one passwd before giving up
+
+void generate_batch(const pw_plan_t&, std::size_t, pw_batch_t&, const pw_streams_t&, 
+					pw_stats_t* = nullptr, pw_unique_set_t* = nullptr);
+
+// The generators behind pwgen, for embedding:  the plan and the streams are made once, and 
+// next() and fill_batch() then only generate.  fill_batch() is generate_batch() on the 
+// generator's streams, which it advances past the batch; next() draws from an engine of its 
+// own, so w/o seekable streams a lone passwd costs no engine setup.  W/ seekable streams, 
+// passwd i of the generator is passwd i of the pwgen run w/ the same --seed or -H, whichever 
+// call made it.  A generator is used by one thread at a time.  
+class pw_generator_t {
+public:
+	pw_generator_t(pw_plan_t, const pw_streams_t&);
+	explicit pw_generator_t(const pw_opts_t&);  // Random key from the OS, 1 thread
+
+	void next(char*);  // opts().pw_length chars
+	std::string next();
+	void fill_batch(std::size_t, pw_batch_t&, pw_stats_t* = nullptr, pw_unique_set_t* = nullptr);
+	const pw_opts_t& opts() const { return plan.opts; }
+private:
+	pw_plan_t plan;
+	pw_streams_t streams;
+	std::unique_ptr<pw_rng_t> re;  // next()'s engine
+};
+
+// --serve:  passwds handed out by a daemon, from pools of ready ones.  A pool holds 
+// capacity passwds of one generator in locked memory (not swapped out or dumped, where the 
+// OS allows), and a thread of its own refills it whenever it falls below half full; each 
+// slot is wiped as soon as its passwd is taken.  Passwds come out in the generator's order.  
+struct pw_pool_stats_t {
+	std::size_t depth {0};  // Passwds ready
+	std::size_t capacity {0};
+	std::uint64_t served {0};
+	std::uint64_t refilled {0};  // Passwds generated into the pool
+	std::uint64_t waits {0};  // take()s that found the pool empty
+	double t_refill {0.0};  // Wall time (s) spent generating
+	bool locked {false};  // The slots are mlock()ed
+};
+class pw_pool_t {
+public:
+	pw_pool_t(pw_generator_t, std::size_t capacity);
+	pw_pool_t(const pw_pool_t&) = delete;
+	pw_pool_t& operator=(const pw_pool_t&) = delete;
+	~pw_pool_t();  // Stops the refill thread, then wipes and frees the slots
+
+	void take(char*);  // The next passwd, length() chars; waits while the pool is empty
+	int length() const { return len; }
+	pw_pool_stats_t stats() const;
+private:
+	void refill();
+
+	pw_generator_t gen;
+	int len {0};
+	std::size_t cap {0};
+	char *slots {nullptr};  // cap passwds of len chars; [head, head + depth) are ready
+	std::size_t map_size {0};
+	std::size_t head {0};
+	std::size_t depth {0};
+	pw_pool_stats_t st {};
+	bool stop {false};
+	mutable std::mutex m;
+	std::condition_variable not_empty {};
+	std::condition_variable low {};
+	std::thread refiller {};
+};
+constexpr std::size_t pw_pool_size {4096};  // Passwds per profile, at most
+constexpr std::size_t pw_pool_max_bytes {1 << 20};  // Per profile; long passwds get fewer slots
+constexpr std::size_t pw_serve_max_profiles {16};
+constexpr int pw_serve_max_length {1024};  // Longest passwd served
+constexpr int pw_serve_max_connections {64};  // Clients served at once; the rest wait
+int pw_listen(const std::string&);  // A socket bound to path, mode 0600; -1 => see errno
+// Answers the clients of the listening socket fd until accept(2) fails (or fd is shut 
+// down); gen is the default profile.  See pw_serve.cpp for the protocol.  
+void pw_serve(int, pw_generator_t);
+
+// A bounded lock-free multi-producer/multi-consumer queue of fixed-width passwds, after 
+// Vyukov's bounded MPMC queue:  each cell has a sequence number that says whose turn it is, 
+// so a push or a pop claims its cell w/ one CAS on the tail or head and hands it on w/ one 
+// release store.  A popped slot is wiped.  size() is exact only when nothing is running.  
+class pw_ring_t {
+public:
+	pw_ring_t(std::size_t capacity, int width);  // capacity is rounded up to a power of 2
+	bool try_push(const char*);  // width chars; false => full
+	bool try_pop(char*);  // false => empty
+	std::size_t size() const;
+	std::size_t capacity() const { return mask + 1; }
+	int width() const { return w; }
+private:
+	struct alignas(64) cursor_t {  // The head and tail on lines of their own
+		std::atomic<std::size_t> pos {0};
+	};
+	cursor_t head {};
+	cursor_t tail {};
+	std::vector<std::atomic<std::size_t>> seq;
+	std::vector<char> slots {};
+	std::size_t mask {0};
+	int w {0};
+};
+
+// A ring of one plan's passwds kept ahead of demand by producer threads, each w/ a 
+// generator (and OS key) of its own:  once a take leaves fewer than low passwds, they fill 
+// the ring back up to high.  The consumers' side is lock-free; a consumer only takes the 
+// producers' mutex to wake them, once per refill.  
+class pw_ring_pool_t {
+public:
+	pw_ring_pool_t(const pw_plan_t&, std::size_t capacity, std::size_t low, std::size_t high, 
+					int nproducers = 1);  // nproducers == 0 => one per hardware thread
+	pw_ring_pool_t(const pw_ring_pool_t&) = delete;
+	pw_ring_pool_t& operator=(const pw_ring_pool_t&) = delete;
+	~pw_ring_pool_t();
+
+	bool try_take(char*);  // length() chars; false => the ring was empty
+	void take(char*);  // Yields until a passwd is ready
+	int length() const { return ring.width(); }
+	std::size_t size() const { return ring.size(); }
+	std::uint64_t empty_takes() const { return nempty.load(std::memory_order_relaxed); }
+private:
+	void produce(pw_generator_t);
+
+	pw_ring_t ring;
+	std::size_t low {0};
+	std::size_t high {0};
+	std::atomic<bool> stop {false};
+	std::atomic<bool> woken {false};  // A consumer has woken the producers for this refill
+	std::atomic<std::uint64_t> nempty {0};
+	std::mutex m;
+	std::condition_variable below_low {};
+	std::vector<std::thread> producers {};
+};
+
+// Buffered output:  passwds, separators and newlines are formatted into buf, which is 
+// flushed to fd w/ a write(2) each time it fills.  A row holds num_cols passwds separated 
+// by ' '; num_cols == 1 => one passwd per line.  
+struct pw_writer_t {
+	static constexpr std::size_t capacity {1<<20};
+	int fd {1};
+	int num_cols {1};
+	int col {0};  // Column of the next passwd
+	std::vector<char> buf {};
+};
+pw_writer_t make_writer(int, int);
+bool write_batch(pw_writer_t&, const pw_batch_t&);  // false => write error; see errno
+bool flush_writer(pw_writer_t&);
+bool finish_writer(pw_writer_t&);  // Ends a partial row, then flushes
+int pw_open_output(const std::string&);
+void pw_ignore_sigpipe();  // A closed pipe then fails write(2) w/ EPIPE instead of killing us
+bool pw_is_tty(int);
+int pw_term_width(int);  // The width of the terminal on fd, or 80
+int pw_num_cols(int, int);
+
+// Settings of a pwgen run other than the pw_opts_t passed to the generators
+struct run_opts_t {
+	int threads {1};  // --threads; 0 => one per hardware thread
+	bool threads_set {false};  // --threads given; else --sha1-tree hashes on every core
+	bool have_seed {false};
+	chacha20_key_t seed {};  // --seed:  the run's whole key
+	std::string sha1 {};  // -H path/to/file[#seed]
+	bool sha1_tree {false};  // --sha1-tree
+	bool have_index {false};
+	std::uint64_t index {0};  // --index:  first passwd of a seekable run
+	std::string output {};  // --output; default stdout
+	bool cols_set {false};  // -C or -1 given; else columns iff the output is a tty
+	bool help {false};
+	bool dump_phonemes {false};  // --dump-phonemes
+	bool entropy {false};  // --entropy
+	bool unique {false};  // --unique
+	bool stream {false};  // --stream, or num_pw == 0:  until the output is closed
+	bool stats {false};  // --stats[=json]:  print a summary of the run's counters to stderr
+	bool stats_json {false};
+	std::string serve {};  // --serve:  socket path
+};
+void parse_args(const std::vector<std::string>&, pw_opts_t&, run_opts_t&);
+void parse_args(int, char**, pw_opts_t&, run_opts_t&);  // argv[1..argc)
+void parse_args(const std::string&, pw_opts_t&, run_opts_t&);  // "-sy -r O0 16"
+pw_streams_t make_streams(const run_opts_t&);  // The key (or -H digest) and threads of a run
+// A generator for options as on the command line; the options that only concern a run 
+// (num_pw, --output, --stream, ...) are parsed and ignored
+pw_generator_t make_generator(const std::string&);
 std::string usage();  // Prints usage info
 
 
@@ -78,9 +531,11 @@ std::string usage();  // Prints usage info
 //extern const char *pw_symbols;
 //extern const char *pw_ambiguous;
 
-// sha1num.c //
-void pw_sha1_init(char *sha1);
-int pw_sha1_number(int max_num);
+// sha1num.cpp //
+// Sets d to the SHA-1 of path/to/file[#seed] (see sha1_engine), or w/ tree the root of a 
+// hash tree of the file's leaves computed on nthreads threads; false if the file can't be read
+constexpr std::size_t pw_sha1_leaf_size {std::size_t {1} << 20};
+bool pw_sha1_init(const std::string& sha1, sha1_digest_t& d, bool tree = false, int nthreads = 1);
 
 
 
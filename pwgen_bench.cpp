@@ -0,0 +1,373 @@
+// pwgen_bench.cpp -- throughput of the password generators
+// Copyright (C) 2019 by Ben Knowles
+// This file may be distributed under the terms of the GNU Public License.
+//
+// Usage:  pwgen_bench [filter]
+// Runs every case whose name contains filter (default all) and prints one line per case:
+// passwds/s, ns/passwd and RNG words per passwd (calls/s and ns/call for the C interface),
+// then the MB/s and ns/word of the raw engines against std::mt19937, the latency of taking 
+// passwds from a ring under 1-64 consumer threads, and the MB/s of hashing a -H seed file 
+// each way.
+// The cases, their order and the RNG key are fixed, so the words/passwd column is exactly
+// reproducible and two runs can be diffed; the timings are the best of 3 runs (the ring's,
+// of one).
+//
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include "pwgen.h"
+#include "sha1.h"
+#include "libpwgen.h"
+
+
+struct bench_case_t {
+	std::string name {};
+	pw_opts_t opts {};
+	bool sha1 {false};  // -H:  sha1_engine instead of chacha20_engine; needs seekable
+	bool seekable {false};  // A stream per passwd, as for --seed and -H (see pw_streams_t)
+};
+
+struct bench_result_t {
+	double ns {0.0};  // Per passwd (or per call), best of the runs
+	double draws {0.0};  // RNG words per passwd
+};
+
+constexpr int bench_nruns {3};
+constexpr std::size_t bench_nchars {1 << 21};  // Chars generated per run
+
+const chacha20_key_t bench_key {0x62656e63,0x68};  // "bench"
+const sha1_digest_t bench_digest {0x62,0x65,0x6e,0x63,0x68};
+
+bench_result_t bench_generator(const bench_case_t& c) {
+	const pw_plan_t plan = make_pw_plan(c.opts);
+	const std::size_t n = std::max<std::size_t>(bench_nchars/c.opts.pw_length,1);
+	pw_batch_t batch {};
+	bench_result_t r {1e300, 0.0};
+	for (int run=0; run<bench_nruns; ++run) {
+		pw_stats_t st {};
+		if (c.seekable) {
+			const pw_streams_t streams {bench_key, 0, 1, c.sha1, bench_digest, true};
+			generate_batch(plan,n,batch,streams,&st);
+		} else {
+			chacha20_engine re(bench_key,0);
+			generate_batch(plan,n,batch,re,&st);
+		}
+		r.ns = std::min(r.ns,1e9*st.t_generate/n);
+		r.draws = static_cast<double>(st.ndraws)/n;
+	}
+	return r;
+}
+
+// A raw engine (any UniformRandomBitGenerator) through operator():  ns per result word, 
+// best of the runs, and the MB/s that makes
+struct bench_engine_result_t {
+	double ns {0.0};
+	double mbs {0.0};
+};
+
+template<typename Reng>
+bench_engine_result_t bench_engine(Reng& re) {
+	using word_t = typename Reng::result_type;
+	const double nbytes = (Reng::max() > 0xffffffffu) ? 8.0 : 4.0;  // mt19937's word_t is wider
+	const std::size_t n = bench_nchars;
+	bench_engine_result_t r {1e300, 0.0};
+	for (int run=0; run<bench_nruns; ++run) {
+		word_t x {0};
+		const auto t0 = std::chrono::steady_clock::now();
+		for (std::size_t i=0; i<n; ++i) {
+			x ^= re();
+		}
+		r.ns = std::min(r.ns,1e9*seconds_since(t0)/n);
+		volatile word_t sink = x;  (void)sink;
+	}
+	r.mbs = 1e3*nbytes/r.ns;
+	return r;
+}
+
+// Hashing a -H seed file of bench_seed_size bytes (from the page cache after the first run) 
+// with hash(path); MB/s, best of the runs
+constexpr std::size_t bench_seed_size {std::size_t {128} << 20};
+
+template<typename F>
+double bench_seed_file(const std::string& path, F hash) {
+	double t {1e300};
+	for (int run=0; run<bench_nruns; ++run) {
+		const auto t0 = std::chrono::steady_clock::now();
+		hash(path);
+		t = std::min(t,seconds_since(t0));
+	}
+	return bench_seed_size/t/1e6;
+}
+
+// The C version's pw_sha1_init():  fread() 1 KiB at a time into one context
+void sha1_fread_1k(const std::string& path) {
+	std::FILE *f = std::fopen(path.c_str(),"rb");
+	sha1_context ctx;
+	sha1_starts(&ctx);
+	std::array<uint8,1024> buf {};
+	std::size_t n {0};
+	while ((n = std::fread(buf.data(),1,buf.size(),f)) > 0) {
+		sha1_update(&ctx,buf.data(),static_cast<uint32>(n));
+	}
+	std::fclose(f);
+	std::array<uint8,20> d {};
+	sha1_finish(&ctx,d.data());
+}
+
+// sample_if() picking an element w/ a 13-in-40 predicate, as pw_phonemes() once picked vowels
+bench_result_t bench_sample_if() {
+	std::array<int,40> elems {};
+	for (std::size_t i=0; i<elems.size(); ++i) { elems[i] = static_cast<int>(i); }
+	auto pred = [](int e) -> bool { return (e % 3) == 0 && e < 39; };
+	const std::size_t n = bench_nchars;
+	bench_result_t r {1e300, 0.0};
+	for (int run=0; run<bench_nruns; ++run) {
+		chacha20_engine re(bench_key,0);
+		int e {0};
+		std::uint64_t sum {0};
+		const auto t0 = std::chrono::steady_clock::now();
+		for (std::size_t i=0; i<n; ++i) {
+			sample_if(elems.begin(),elems.end(),&e,re,pred);
+			sum += e;
+		}
+		r.ns = std::min(r.ns,1e9*seconds_since(t0)/n);
+		r.draws = static_cast<double>(re.draws())/n;
+		volatile std::uint64_t sink = sum;  (void)sink;
+	}
+	return r;
+}
+
+// The C interface in a loop:  pwgen_next() for one passwd (len 12 phonemes), and 
+// pwgen_new() + pwgen_free(), the one-time cost an embedding pays instead of a fork/exec
+bench_result_t bench_c_api(bool setup) {
+	const std::size_t n = setup ? 1000 : bench_nchars/12;
+	bench_result_t r {1e300, 0.0};
+	std::array<char,13> pw {};
+	for (int run=0; run<bench_nruns; ++run) {
+		pwgen_t *pg = pwgen_new("12");
+		const auto t0 = std::chrono::steady_clock::now();
+		for (std::size_t i=0; i<n; ++i) {
+			if (setup) {
+				pwgen_free(pwgen_new("12"));
+			} else {
+				pwgen_next(pg,pw.data(),pw.size());
+			}
+		}
+		r.ns = std::min(r.ns,1e9*seconds_since(t0)/n);
+		pwgen_free(pg);
+	}
+	return r;
+}
+
+// Consumers of a pw_ring_pool_t of len 12 phoneme passwds, a producer per hardware thread:  
+// nthreads consumers share bench_ring_takes takes from a full ring, each take timed alone
+constexpr std::size_t bench_ring_takes {1 << 18};
+
+struct ring_result_t {
+	double takes {0.0};  // Per second, all consumers together
+	double p50 {0.0};  // ns per take
+	double p99 {0.0};
+	double empty {0.0};  // Fraction of try_take()s that found the ring empty
+};
+
+ring_result_t bench_ring(const pw_plan_t& plan, int nthreads) {
+	pw_ring_pool_t pool(plan,1 << 16,1 << 14,1 << 16,0);
+	for (int i=0; i<10000 && pool.size() < (1 << 16); ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	std::vector<std::vector<float>> lat(nthreads);
+	std::vector<std::thread> consumers {};
+	const auto t0 = std::chrono::steady_clock::now();
+	for (int t=0; t<nthreads; ++t) {
+		consumers.emplace_back([&pool,&lat,nthreads,t]() -> void {
+			std::string pw(pool.length(),'\0');
+			const std::size_t n = bench_ring_takes/nthreads;
+			lat[t].reserve(n);
+			for (std::size_t i=0; i<n; ++i) {
+				const auto t1 = std::chrono::steady_clock::now();
+				pool.take(pw.data());
+				lat[t].push_back(static_cast<float>(1e9*seconds_since(t1)));
+			}
+		});
+	}
+	for (auto& c : consumers) {
+		c.join();
+	}
+	const double t = seconds_since(t0);
+	std::vector<float> all {};
+	for (const auto& l : lat) {
+		all.insert(all.end(),l.begin(),l.end());
+	}
+	std::sort(all.begin(),all.end());
+	ring_result_t r {};
+	r.takes = all.size()/t;
+	r.p50 = all[all.size()/2];
+	r.p99 = all[all.size()*99/100];
+	r.empty = static_cast<double>(pool.empty_takes())/(pool.empty_takes() + all.size());
+	return r;
+}
+
+std::vector<bench_case_t> make_cases() {
+	struct option_set_t {
+		const char *name;
+		void (*apply)(pw_opts_t&);
+		bool sha1;
+		bool seekable;
+	};
+	const std::vector<option_set_t> sets {
+		{"phonemes", [](pw_opts_t&) {}, false, false},
+		{"phonemes -0A", [](pw_opts_t& o) { o.digits = false;  o.uppers = false; }, false, false},
+		{"phonemes -y", [](pw_opts_t& o) { o.symbols = true; }, false, false},
+		{"phonemes -B", [](pw_opts_t& o) { o.no_ambiguous = true; }, false, false},
+		{"phonemes -r aeiou", [](pw_opts_t& o) { o.remove_chars = "aeiou"; }, false, false},
+		{"rand -s", [](pw_opts_t& o) { o.random = true; }, false, false},
+		{"rand -s0A", [](pw_opts_t& o) { o.random = true;  o.digits = false;  o.uppers = false; }, 
+			false, false},
+		{"rand -sy", [](pw_opts_t& o) { o.random = true;  o.symbols = true; }, false, false},
+		{"rand -sB", [](pw_opts_t& o) { o.random = true;  o.no_ambiguous = true; }, false, false},
+		{"rand -s -r aeiou", [](pw_opts_t& o) { o.random = true;  o.remove_chars = "aeiou"; }, 
+			false, false},
+		{"rand -sy --constructive", [](pw_opts_t& o) {
+			o.random = true;  o.symbols = true;  o.constructive = true; }, false, false},
+		{"phonemes --seed", [](pw_opts_t&) {}, false, true},
+		{"rand -s --seed", [](pw_opts_t& o) { o.random = true; }, false, true},
+		{"phonemes -H", [](pw_opts_t&) {}, true, true},
+		{"rand -s -H", [](pw_opts_t& o) { o.random = true; }, true, true}
+	};
+	const std::array<int,8> lengths {5, 8, 12, 16, 24, 32, 64, 128};
+
+	std::vector<bench_case_t> cases {};
+	for (const auto& s : sets) {
+		for (const auto& len : lengths) {
+			bench_case_t c {};
+			c.name = s.name;
+			s.apply(c.opts);
+			c.opts.pw_length = len;
+			c.sha1 = s.sha1;
+			c.seekable = s.seekable;
+			cases.push_back(c);
+		}
+	}
+	return cases;
+}
+
+int main(int argc, char **argv) {
+	const std::string filter = (argc > 1) ? argv[1] : "";
+
+	printf( "%-26s %4s %14s %12s %10s\n", "case", "len", "passwords/s", "ns/password", "draws/pw" );
+	for (const auto& c : make_cases()) {
+		if (c.name.find(filter) == std::string::npos) { continue; }
+		const auto r = bench_generator(c);
+		printf( "%-26s %4d %14.0f %12.1f %10.2f\n", c.name.c_str(), c.opts.pw_length,
+			1e9/r.ns, r.ns, r.draws );
+	}
+	if (std::string("sample_if").find(filter) != std::string::npos) {
+		const auto r = bench_sample_if();
+		printf( "%-26s %4s %14.0f %12.1f %10.2f\n", "sample_if", "-", 1e9/r.ns, r.ns, r.draws );
+	}
+	for (const bool setup : {false, true}) {
+		const char *name = setup ? "pwgen_new + pwgen_free" : "pwgen_next";
+		if (std::string(name).find(filter) == std::string::npos) { continue; }
+		const auto r = bench_c_api(setup);
+		printf( "%-26s %4d %14.0f %12.1f %10s\n", name, 12, 1e9/r.ns, r.ns, "-" );
+	}
+
+	// The raw engines:  std::mt19937 and std::mt19937_64 (what pwgen used before ChaCha20) 
+	// for comparison, chacha20_engine w/ the scalar block function and (if the cpu has it) 
+	// the avx2 one, and sha1_engine w/ each compression function the cpu has.  ns/word is 
+	// per call, a 64-bit word for mt19937_64 and a 32-bit one for the rest.  
+	bool engine_header {false};
+	auto engine_row = [&engine_header](const std::string& name, const bench_engine_result_t& r) {
+		if (!engine_header) {
+			printf( "\n%-26s %14s %12s\n", "engine", "MB/s", "ns/word" );
+			engine_header = true;
+		}
+		printf( "%-26s %14.1f %12.2f\n", name.c_str(), r.mbs, r.ns );
+	};
+	if (std::string("std::mt19937").find(filter) != std::string::npos) {
+		std::mt19937 re {};
+		engine_row("std::mt19937",bench_engine(re));
+	}
+	if (std::string("std::mt19937_64").find(filter) != std::string::npos) {
+		std::mt19937_64 re {};
+		engine_row("std::mt19937_64",bench_engine(re));
+	}
+	for (const bool simd : {false, true}) {
+		const std::string name = std::string("chacha20_engine ") + (simd ? "avx2" : "scalar");
+		chacha20_engine re(bench_key,0);
+		if (name.find(filter) == std::string::npos || (simd && !re.simd)) {
+			continue;
+		}
+		re.simd = simd;
+		engine_row(name,bench_engine(re));
+	}
+	const sha1_impl_t best_impl = sha1_impl;
+	const std::array<const char*,3> impl_names {"sha-ni", "avx2", "portable"};
+	for (int k=SHA1_SHANI; k<=SHA1_PORTABLE; ++k) {
+		const std::string name = std::string("sha1_engine ") + impl_names[k];
+		if (name.find(filter) == std::string::npos || !sha1_impl_supported(static_cast<sha1_impl_t>(k))) {
+			continue;
+		}
+		sha1_impl = static_cast<sha1_impl_t>(k);
+		sha1_engine re(bench_digest,0);
+		engine_row(name,bench_engine(re));
+	}
+	sha1_impl = best_impl;
+
+	if (std::string("ring consumers").find(filter) != std::string::npos) {
+		pw_opts_t opts {};
+		opts.pw_length = 12;
+		const pw_plan_t plan = make_pw_plan(opts);
+		printf( "\n%-26s %14s %12s %12s %10s\n", "ring consumers (len 12)", "takes/s", "p50 ns", 
+			"p99 ns", "empty %" );
+		for (const int nt : {1, 2, 4, 8, 16, 32, 64}) {
+			const auto r = bench_ring(plan,nt);
+			const std::string name = std::to_string(nt) + (nt == 1 ? " thread" : " threads");
+			printf( "%-26s %14.0f %12.0f %12.0f %10.2f\n", name.c_str(), r.takes, r.p50, r.p99, 
+				100*r.empty );
+		}
+	}
+
+	if (std::string("seed file").find(filter) != std::string::npos) {
+		const std::string path {"pwgen_bench_seed.tmp"};
+		std::FILE *f = std::fopen(path.c_str(),"wb");
+		std::vector<char> block(1 << 20);
+		for (std::size_t i=0; i<bench_seed_size; i += block.size()) {
+			for (auto& c : block) { c = static_cast<char>(i + (&c-block.data())*131); }
+			std::fwrite(block.data(),1,block.size(),f);
+		}
+		std::fclose(f);
+
+		const int nt = std::max(static_cast<int>(std::thread::hardware_concurrency()),1);
+		printf( "\n%-26s %14s\n", "seed file (128 MiB)", "MB/s" );
+		sha1_impl = SHA1_PORTABLE;
+		printf( "%-26s %14.0f\n", "fread 1 KiB (C version)", bench_seed_file(path,sha1_fread_1k) );
+		sha1_digest_t d {};
+		for (int k=SHA1_PORTABLE; k>=SHA1_SHANI; --k) {
+			if (!sha1_impl_supported(static_cast<sha1_impl_t>(k))) { continue; }
+			sha1_impl = static_cast<sha1_impl_t>(k);
+			const std::string name = std::string("sequential, ") + impl_names[k];
+			printf( "%-26s %14.0f\n", name.c_str(), bench_seed_file(path,[&d](const std::string& p) {
+				pw_sha1_init(p,d); }) );
+		}
+		sha1_impl = best_impl;
+		printf( "%-26s %14.0f\n", "tree, 1 thread", bench_seed_file(path,[&d](const std::string& p) {
+			pw_sha1_init(p,d,true,1); }) );
+		if (nt > 1) {
+			const std::string tree_nt = "tree, " + std::to_string(nt) + " threads";
+			printf( "%-26s %14.0f\n", tree_nt.c_str(), bench_seed_file(path,[&d,nt](const std::string& p) {
+				pw_sha1_init(p,d,true,nt); }) );
+		}
+		std::remove(path.c_str());
+	}
+
+	return 0;
+}
+
@@ -18,16 +18,14 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
-/*
 
 #include <string.h>
+#include <stddef.h>
 
 #include "sha1.h"
+#include "pw_cpu.h"
 
 
-void sha1_process(sha1_context *ctx, uint8 data[64]);
-			
-
 #define GET_UINT32(n,b,i)                       \
 {                                               \
     (n) = ( (uint32) (b)[(i)    ] << 24 )       \
@@ -44,8 +42,7 @@ void sha1_process(sha1_context *ctx, uint8 data[64]);
     (b)[(i) + 3] = (uint8) ( (n)       );       \
 }
 
-void sha1_starts(ctx)
-	sha1_context *ctx;
+void sha1_starts( sha1_context *ctx )
 {
     ctx->total[0] = 0;
     ctx->total[1] = 0;
@@ -57,9 +54,7 @@ void sha1_starts(ctx)
     ctx->state[4] = 0xC3D2E1F0;
 }
 
-void sha1_process(ctx, data)
-	sha1_context *ctx;
-	uint8 data[64];
+static void sha1_process_portable( uint32 state[5], const uint8 data[64] )
 {
     uint32 temp, W[16], A, B, C, D, E;
 
@@ -80,7 +75,7 @@ void sha1_process(ctx, data)
     GET_UINT32( W[14], data, 56 );
     GET_UINT32( W[15], data, 60 );
 
-#define S(x,n) ((x << n) | ((x & 0xFFFFFFFF) >> (32 - n)))
+#define S(x,n) ((x << n) | (x >> (32 - n)))
 
 #define R(t)                                            \
 (                                                       \
@@ -94,11 +89,11 @@ void sha1_process(ctx, data)
     e += S(a,5) + F(b,c,d) + K + x; b = S(b,30);        \
 }
 
-    A = ctx->state[0];
-    B = ctx->state[1];
-    C = ctx->state[2];
-    D = ctx->state[3];
-    E = ctx->state[4];
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
 
 #define F(x,y,z) (z ^ (x & (y ^ z)))
 #define K 0x5A827999
@@ -208,17 +203,228 @@ void sha1_process(ctx, data)
 #undef K
 #undef F
 
-    ctx->state[0] += A;
-    ctx->state[1] += B;
-    ctx->state[2] += C;
-    ctx->state[3] += D;
-    ctx->state[4] += E;
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+}
+
+#if PW_HAVE_X86
+
+/*
+ * SHA-NI:  sha1rnds4 does 4 rounds, sha1nexte adds E (rotated) to the next 4 schedule
+ * words, and sha1msg1/sha1msg2 around a xor compute 4 schedule words.  Group i (rounds
+ * 4i..4i+3) uses W[4i..4i+3] from m[i % 4] and advances the schedule for the groups i+1
+ * (msg2), i+2 (xor) and i+3 (msg1).  The state stays in registers across the blocks.
+ */
+#define SHA1_NI_GROUP(i)                                                        \
+{                                                                               \
+    if( i == 0 )                                                                \
+        e[0] = _mm_add_epi32( e[0], m[0] );                                     \
+    else                                                                        \
+        e[i % 2] = _mm_sha1nexte_epu32( e[i % 2], m[i % 4] );                   \
+    e[(i + 1) % 2] = abcd;                                                      \
+    if( i >= 3 && i <= 18 )                                                     \
+        m[(i + 1) % 4] = _mm_sha1msg2_epu32( m[(i + 1) % 4], m[i % 4] );        \
+    abcd = _mm_sha1rnds4_epu32( abcd, e[i % 2], i / 5 );                        \
+    if( i >= 1 && i <= 16 )                                                     \
+        m[(i + 3) % 4] = _mm_sha1msg1_epu32( m[(i + 3) % 4], m[i % 4] );        \
+    if( i >= 2 && i <= 17 )                                                     \
+        m[(i + 2) % 4] = _mm_xor_si128( m[(i + 2) % 4], m[i % 4] );             \
+}
+
+PW_TARGET_SHA
+static void sha1_blocks_shani( uint32 state[5], const uint8 *data, size_t n )
+{
+    const __m128i bswap = _mm_set_epi64x( 0x0001020304050607LL, 0x08090a0b0c0d0e0fLL );
+    __m128i abcd, abcd_save, e[2], e_save, m[4];
+    int i;
+
+    abcd = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i *) state ), 0x1B );
+    e[0] = _mm_set_epi32( (int) state[4], 0, 0, 0 );
+
+    for( ; n > 0; n--, data += 64 )
+    {
+        abcd_save = abcd;
+        e_save = e[0];
+
+        for( i = 0; i < 4; i++ )
+        {
+            m[i] = _mm_shuffle_epi8( _mm_loadu_si128(
+                       (const __m128i *) ( data + 16 * i ) ), bswap );
+        }
+
+        SHA1_NI_GROUP(  0 ); SHA1_NI_GROUP(  1 ); SHA1_NI_GROUP(  2 );
+        SHA1_NI_GROUP(  3 ); SHA1_NI_GROUP(  4 ); SHA1_NI_GROUP(  5 );
+        SHA1_NI_GROUP(  6 ); SHA1_NI_GROUP(  7 ); SHA1_NI_GROUP(  8 );
+        SHA1_NI_GROUP(  9 ); SHA1_NI_GROUP( 10 ); SHA1_NI_GROUP( 11 );
+        SHA1_NI_GROUP( 12 ); SHA1_NI_GROUP( 13 ); SHA1_NI_GROUP( 14 );
+        SHA1_NI_GROUP( 15 ); SHA1_NI_GROUP( 16 ); SHA1_NI_GROUP( 17 );
+        SHA1_NI_GROUP( 18 ); SHA1_NI_GROUP( 19 );
+
+        e[0] = _mm_sha1nexte_epu32( e[0], e_save );
+        abcd = _mm_add_epi32( abcd, abcd_save );
+    }
+
+    _mm_storeu_si128( (__m128i *) state, _mm_shuffle_epi32( abcd, 0x1B ) );
+    state[4] = (uint32) _mm_extract_epi32( e[0], 3 );
+}
+
+#undef SHA1_NI_GROUP
+
+/*
+ * AVX2:  the message schedule of two consecutive blocks, one per 128-bit lane, four
+ * words at a time, w/ the round constants added.  W[t] for 16 <= t < 32 needs W[t-3],
+ * which for the last word of a group is the first word of the same group, so that word
+ * is fixed up after the fact; from t = 32 on, W[t] = S(W[t-6] ^ W[t-16] ^ W[t-28] ^
+ * W[t-32], 2) has no such dependency.  The rounds are then the portable rounds.
+ */
+PW_TARGET_AVX2
+static inline __m256i sha1_rol_avx2( __m256i x, int n )
+{
+    return( _mm256_or_si256( _mm256_slli_epi32( x, n ), _mm256_srli_epi32( x, 32 - n ) ) );
+}
+
+PW_TARGET_AVX2
+static void sha1_schedule2_avx2( const uint8 data[128], uint32 wk[2][80] )
+{
+    const __m256i bswap = _mm256_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+    static const int K[4] = { 0x5A827999, 0x6ED9EBA1, (int) 0x8F1BBCDC, (int) 0xCA62C1D6 };
+    __m256i w[20], x;
+    int g;
+
+    for( g = 0; g < 4; g++ )
+    {
+        w[g] = _mm256_inserti128_si256( _mm256_castsi128_si256(
+                   _mm_loadu_si128( (const __m128i *) ( data + 16 * g ) ) ),
+                   _mm_loadu_si128( (const __m128i *) ( data + 64 + 16 * g ) ), 1 );
+        w[g] = _mm256_shuffle_epi8( w[g], bswap );
+    }
+
+    for( g = 4; g < 8; g++ )
+    {
+        x = _mm256_xor_si256( _mm256_srli_si256( w[g - 1], 4 ), w[g - 2] );
+        x = _mm256_xor_si256( x, _mm256_alignr_epi8( w[g - 3], w[g - 4], 8 ) );
+        x = sha1_rol_avx2( _mm256_xor_si256( x, w[g - 4] ), 1 );
+        w[g] = _mm256_xor_si256( x, sha1_rol_avx2( _mm256_slli_si256( x, 12 ), 1 ) );
+    }
+
+    for( g = 8; g < 20; g++ )
+    {
+        x = _mm256_xor_si256( _mm256_alignr_epi8( w[g - 1], w[g - 2], 8 ), w[g - 4] );
+        x = _mm256_xor_si256( x, _mm256_xor_si256( w[g - 7], w[g - 8] ) );
+        w[g] = sha1_rol_avx2( x, 2 );
+    }
+
+    for( g = 0; g < 20; g++ )
+    {
+        x = _mm256_add_epi32( w[g], _mm256_set1_epi32( K[g / 5] ) );
+        _mm_storeu_si128( (__m128i *) ( wk[0] + 4 * g ), _mm256_castsi256_si128( x ) );
+        _mm_storeu_si128( (__m128i *) ( wk[1] + 4 * g ), _mm256_extracti128_si256( x, 1 ) );
+    }
+}
+
+#endif
+
+/* The 80 rounds on a schedule w/ the constants already added */
+static void sha1_rounds( uint32 state[5], const uint32 wk[80] )
+{
+    uint32 A, B, C, D, E;
+    int t;
+
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
+
+#define K 0
+#define P5(t)                                                                   \
+{                                                                               \
+    P( A, B, C, D, E, wk[t]     );                                              \
+    P( E, A, B, C, D, wk[t + 1] );                                              \
+    P( D, E, A, B, C, wk[t + 2] );                                              \
+    P( C, D, E, A, B, wk[t + 3] );                                              \
+    P( B, C, D, E, A, wk[t + 4] );                                              \
+}
+
+#define F(x,y,z) (z ^ (x & (y ^ z)))
+    for( t =  0; t < 20; t += 5 ) P5( t );
+#undef F
+#define F(x,y,z) (x ^ y ^ z)
+    for( t = 20; t < 40; t += 5 ) P5( t );
+#undef F
+#define F(x,y,z) ((x & y) | (z & (x | y)))
+    for( t = 40; t < 60; t += 5 ) P5( t );
+#undef F
+#define F(x,y,z) (x ^ y ^ z)
+    for( t = 60; t < 80; t += 5 ) P5( t );
+#undef F
+
+#undef P5
+#undef K
+
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+}
+
+int sha1_impl_supported( sha1_impl_t impl )
+{
+    switch( impl )
+    {
+        case SHA1_SHANI:    return( cpu_has_sha() );
+        case SHA1_AVX2:     return( cpu_has_avx2() );
+        default:            return( 1 );
+    }
+}
+
+static sha1_impl_t sha1_best_impl( void )
+{
+    if( sha1_impl_supported( SHA1_SHANI ) ) return( SHA1_SHANI );
+    if( sha1_impl_supported( SHA1_AVX2 ) )  return( SHA1_AVX2 );
+    return( SHA1_PORTABLE );
 }
 
-void sha1_update(ctx, input, length )
-	sha1_context *ctx;
-	uint8 *input;
-	uint32 length;
+sha1_impl_t sha1_impl = sha1_best_impl();
+
+/* n consecutive blocks w/ the chosen compression function */
+static void sha1_process_blocks( sha1_context *ctx, const uint8 *data, size_t n )
+{
+#if PW_HAVE_X86
+    if( sha1_impl == SHA1_SHANI )
+    {
+        sha1_blocks_shani( ctx->state, data, n );
+        return;
+    }
+    if( sha1_impl == SHA1_AVX2 )
+    {
+        uint32 wk[2][80];
+
+        for( ; n >= 2; n -= 2, data += 128 )
+        {
+            sha1_schedule2_avx2( data, wk );
+            sha1_rounds( ctx->state, wk[0] );
+            sha1_rounds( ctx->state, wk[1] );
+        }
+    }
+#endif
+    for( ; n > 0; n--, data += 64 )
+    {
+        sha1_process_portable( ctx->state, data );
+    }
+}
+
+void sha1_process( sha1_context *ctx, const uint8 data[64] )
+{
+    sha1_process_blocks( ctx, data, 1 );
+}
+
+void sha1_update( sha1_context *ctx, const uint8 *input, uint32 length )
 {
     uint32 left, fill;
 
@@ -228,7 +434,6 @@ void sha1_update(ctx, input, length )
     fill = 64 - left;
 
     ctx->total[0] += length;
-    ctx->total[0] &= 0xFFFFFFFF;
 
     if( ctx->total[0] < length )
         ctx->total[1]++;
@@ -236,28 +441,28 @@ void sha1_update(ctx, input, length )
     if( left && length >= fill )
     {
         memcpy( (void *) (ctx->buffer + left),
-                (void *) input, fill );
+                (const void *) input, fill );
         sha1_process( ctx, ctx->buffer );
         length -= fill;
         input  += fill;
         left = 0;
     }
 
-    while( length >= 64 )
+    if( length >= 64 )
     {
-        sha1_process( ctx, input );
-        length -= 64;
-        input  += 64;
+        sha1_process_blocks( ctx, input, length / 64 );
+        input  += length & ~0x3F;
+        length &= 0x3F;
     }
 
     if( length )
     {
         memcpy( (void *) (ctx->buffer + left),
-                (void *) input, length );
+                (const void *) input, length );
     }
 }
 
-static uint8 sha1_padding[64] =
+static const uint8 sha1_padding[64] =
 {
  0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -265,9 +470,7 @@ static uint8 sha1_padding[64] =
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
 
-void sha1_finish( ctx, digest )
-	sha1_context *ctx;
-	uint8 digest[20];
+void sha1_finish( sha1_context *ctx, uint8 digest[20] )
 {
     uint32 last, padn;
     uint32 high, low;
@@ -302,26 +505,26 @@ void sha1_finish( ctx, digest )
 // those are the standard FIPS-180-1 test vectors
 //
 
-static char *msg[] = 
+static const char *msg[] = 
 {
     "abc",
     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
     NULL
 };
 
-static char *val[] =
+static const char *val[] =
 {
     "a9993e364706816aba3e25717850c26c9cd0d89d",
     "84983e441c3bd26ebaae4aa1f95129e5e54670f1",
     "34aa973cd4c4daa4f61eeb2bdbad27316534016f"
 };
 
-int main( argc, argv )
-	int argc;
-	char **argv;
+static const char *impl_name[] = { "sha-ni", "avx2", "portable" };
+
+int main( int argc, char **argv )
 {
     FILE *f;
-    int i, j;
+    int i, j, k;
     char output[41];
     sha1_context ctx;
     unsigned char buf[1000];
@@ -331,41 +534,52 @@ int main( argc, argv )
     {
         printf( "\n SHA-1 Validation Tests:\n\n" );
 
-        for( i = 0; i < 3; i++ )
+        /* each compression function the cpu has, on 1-block and multi-block updates */
+        for( k = SHA1_SHANI; k <= SHA1_PORTABLE; k++ )
         {
-            printf( " Test %d ", i + 1 );
-
-            sha1_starts( &ctx );
-
-            if( i < 2 )
+            if( ! sha1_impl_supported( (sha1_impl_t) k ) )
             {
-                sha1_update( &ctx, (uint8 *) msg[i],
-                             strlen( msg[i] ) );
+                printf( " %s not supported; skipped\n", impl_name[k] );
+                continue;
             }
-            else
+            sha1_impl = (sha1_impl_t) k;
+
+            for( i = 0; i < 3; i++ )
             {
-                memset( buf, 'a', 1000 );
+                printf( " Test %d (%s) ", i + 1, impl_name[k] );
+
+                sha1_starts( &ctx );
 
-                for( j = 0; j < 1000; j++ )
+                if( i < 2 )
                 {
-                    sha1_update( &ctx, (uint8 *) buf, 1000 );
+                    sha1_update( &ctx, (const uint8 *) msg[i],
+                                 strlen( msg[i] ) );
                 }
-            }
+                else
+                {
+                    memset( buf, 'a', 1000 );
 
-            sha1_finish( &ctx, sha1sum );
+                    for( j = 0; j < 1000; j++ )
+                    {
+                        sha1_update( &ctx, (uint8 *) buf, 1000 );
+                    }
+                }
 
-            for( j = 0; j < 20; j++ )
-            {
-                sprintf( output + j * 2, "%02x", sha1sum[j] );
-            }
+                sha1_finish( &ctx, sha1sum );
 
-            if( memcmp( output, val[i], 40 ) )
-            {
-                printf( "failed!\n" );
-                return( 1 );
-            }
+                for( j = 0; j < 20; j++ )
+                {
+                    sprintf( output + j * 2, "%02x", sha1sum[j] );
+                }
+
+                if( memcmp( output, val[i], 40 ) )
+                {
+                    printf( "failed!\n" );
+                    return( 1 );
+                }
 
-            printf( "passed.\n" );
+                printf( "passed.\n" );
+            }
         }
 
         printf( "\n" );
@@ -399,4 +613,3 @@ int main( argc, argv )
 }
 
 #endif
-*/
\ No newline at end of file
@@ -1,13 +1,12 @@
 #ifndef _SHA1_H
 #define _SHA1_H
 
-#ifndef uint8
-#define uint8  unsigned char
-#endif
+#include <cstdint>
 
-#ifndef uint32
-#define uint32 unsigned long int
-#endif
+// uint32 was unsigned long int, which is 64 bits on LP64 targets (Linux, macOS) and broke
+// the rotations and the length arithmetic; the fixed-width types are exact everywhere.
+typedef std::uint8_t uint8;
+typedef std::uint32_t uint32;
 
 typedef struct
 {
@@ -17,8 +16,18 @@ typedef struct
 }
 sha1_context;
 
+/*
+ * The compression function:  the SHA extensions, an AVX2 message schedule for two
+ * blocks at a time, or the portable code.  sha1_impl starts out as the fastest one
+ * the cpu supports; the others are there for the tests and the benchmark.
+ */
+typedef enum { SHA1_SHANI, SHA1_AVX2, SHA1_PORTABLE } sha1_impl_t;
+extern sha1_impl_t sha1_impl;
+int sha1_impl_supported( sha1_impl_t impl );
+
 void sha1_starts( sha1_context *ctx );
-void sha1_update( sha1_context *ctx, uint8 *input, uint32 length );
+void sha1_process( sha1_context *ctx, const uint8 data[64] );
+void sha1_update( sha1_context *ctx, const uint8 *input, uint32 length );
 void sha1_finish( sha1_context *ctx, uint8 digest[20] );
 
 #endif /* sha1.h */
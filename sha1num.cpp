@@ -1,81 +1,331 @@
 //
-// sha1num.c --- generate sha1 hash based, pseudo random numbers
+// sha1num.cpp --- generate sha1 hash based, pseudo random numbers
 //
 // Copyright (C) 2005 by Olivier Guerrier
+// Copyright (C) 2019 by Ben Knowles
 //
 // This file may be distributed under the terms of the GNU Public
 // License.
 //
 
-/*
-#include <string.h>
-#include <stdio.h>
-#include <stdlib.h>
+#include <string>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <thread>
 #include "pwgen.h"
 #include "sha1.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
-sha1_context sha1_ctx;
-char *sha1_seed;
-const char *sha1_magic="pwgen";
-unsigned char sha1sum[20];
-int sha1sum_idx=20;
-	
-void pw_sha1_init(char *sha1)
-{
-        int i = 0;
-	char *seed;
-	FILE *f;
-        unsigned char buf[1024];
-
-	if ((seed = strchr(sha1,'#'))) {
-		*(seed++) = 0;
-		sha1_seed = malloc(strlen(seed)+1);
-	        if (!sha1_seed) {
-	                fprintf(stderr, "Couldn't malloc sha1_seed buffer.\n");
-	                exit(1);
-	        }
-		strcpy(sha1_seed, seed);
-	}
-	else {
-		sha1_seed = malloc(strlen(sha1_magic)+1);
-	        if (!sha1_seed) {
-	                fprintf(stderr, "Couldn't malloc sha1_seed buffer.\n");
-	                exit(1);
-	        }
-		strcpy(sha1_seed, sha1_magic);
-	}
-
-	if( ! ( f = fopen( sha1, "rb" ) ) ) {
-	        fprintf(stderr, "Couldn't open file: %s.\n", sha1);
-		exit(1);
-	}
-
-	sha1_starts( &sha1_ctx );                                   
-	while( ( i = fread( buf, 1, sizeof( buf ), f ) ) > 0 ) {
-		sha1_update( &sha1_ctx, buf, i );
-	}
-
-	fclose(f);
-
-	return;
+const std::string sha1_magic {"pwgen"};  // The seed if -H doesn't give one
+
+//
+// The bytes of a seed file:  mapped w/ sequential read-ahead where the OS allows it, which 
+// lets sha1_update() run over the whole file w/o a read(2) per block.  Pipes, empty files 
+// and _WIN32 fall back to fread() into a buffer.  
+//
+struct seed_file_t {
+	std::FILE *f {nullptr};
+	const uint8 *map {nullptr};
+	std::size_t size {0};  // Of the mapping
+
+	seed_file_t() = default;
+	seed_file_t(const seed_file_t&) = delete;
+	seed_file_t& operator=(const seed_file_t&) = delete;
+	~seed_file_t() {
+#ifndef _WIN32
+		if (map) { munmap(const_cast<uint8*>(map),size); }
+#endif
+		if (f) { std::fclose(f); }
+	}
+};
+
+bool open_seed_file(const std::string& path, seed_file_t& sf) {
+#ifndef _WIN32
+	const int fd = open(path.c_str(),O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st {};
+	if (fstat(fd,&st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *p = mmap(nullptr,static_cast<std::size_t>(st.st_size),PROT_READ,MAP_PRIVATE,fd,0);
+		if (p != MAP_FAILED) {
+#if defined(MADV_SEQUENTIAL)
+			madvise(p,static_cast<std::size_t>(st.st_size),MADV_SEQUENTIAL);
+#endif
+			sf.map = static_cast<const uint8*>(p);
+			sf.size = static_cast<std::size_t>(st.st_size);
+			close(fd);
+			return true;
+		}
+	}
+	close(fd);
+#endif
+	sf.f = std::fopen(path.c_str(),"rb");
+	return sf.f != nullptr;
+}
+
+// Calls consume(p,n) on consecutive pieces of the file of block bytes (the last may be 
+// shorter); false on a read error
+template<typename F>
+bool for_each_block(seed_file_t& sf, std::size_t block, F consume) {
+	if (sf.map) {
+		for (std::size_t i=0; i<sf.size; i += block) {
+			consume(sf.map+i,std::min(block,sf.size-i));
+		}
+		return true;
+	}
+	std::vector<uint8> buf(block);
+	std::size_t n {0};
+	while ((n = std::fread(buf.data(),1,buf.size(),sf.f)) > 0) {
+		consume(buf.data(),n);
+	}
+	return !std::ferror(sf.f);
+}
+
+// sha1_update() takes a 32-bit length
+void sha1_update_all(sha1_context *ctx, const uint8 *p, std::size_t n) {
+	for (std::size_t m=0; n > 0; p += m, n -= m) {
+		m = std::min<std::size_t>(n,std::size_t {1} << 30);
+		sha1_update(ctx,p,static_cast<uint32>(m));
+	}
+}
+
+void sha1_leaf(const uint8 *p, std::size_t n, uint8 *dest) {
+	sha1_context ctx;
+	sha1_starts(&ctx);
+	const uint8 tag {0};
+	sha1_update(&ctx,&tag,1);
+	sha1_update_all(&ctx,p,n);
+	sha1_finish(&ctx,dest);
+}
+
+//
+// d = SHA1(file || seed), for -H path/to/file[#seed].  The C version appended the seed to 
+// the file's hash once more for every 20 bytes of output and finished a copy of the 
+// context each time; the engine below keys a counter mode off d instead.  
+//
+// Tree mode (--sha1-tree) splits the file into leaves of pw_sha1_leaf_size bytes, hashes 
+// leaf j as h_j = SHA1(0x00 || leaf j) on nthreads threads, and sets 
+// d = SHA1(0x01 || h_0 || h_1 || ... || seed).  The digest depends on the leaf size but 
+// not on nthreads; it is not the sequential digest of the same file.  
+//
+bool pw_sha1_init(const std::string& sha1, sha1_digest_t& d, bool tree, int nthreads) {
+	std::string path = sha1;
+	std::string seed = sha1_magic;
+	const auto hash = sha1.find('#');
+	if (hash != std::string::npos) {
+		path = sha1.substr(0,hash);
+		seed = sha1.substr(hash+1);
+	}
+
+	seed_file_t sf {};
+	if (!open_seed_file(path,sf)) {
+		return false;
+	}
+	sha1_context ctx {};
+	sha1_starts(&ctx);
+	bool ok {true};
+	if (!tree) {
+		ok = for_each_block(sf,std::size_t {1} << 20,[&ctx](const uint8 *p, std::size_t n) -> void {
+			sha1_update_all(&ctx,p,n);
+		});
+	} else {
+		const uint8 tag {1};
+		sha1_update(&ctx,&tag,1);
+		if (sf.map) {
+			const std::size_t nleaves = (sf.size + pw_sha1_leaf_size - 1)/pw_sha1_leaf_size;
+			const std::size_t nt = std::clamp<std::size_t>(nthreads,1,std::max<std::size_t>(nleaves,1));
+			std::vector<uint8> h(20*nleaves);
+			auto work = [&sf,&h,nleaves,nt](std::size_t t) -> void {
+				for (std::size_t j=(t*nleaves)/nt; j<((t+1)*nleaves)/nt; ++j) {
+					const std::size_t off = j*pw_sha1_leaf_size;
+					sha1_leaf(sf.map+off,std::min(pw_sha1_leaf_size,sf.size-off),h.data()+20*j);
+				}
+			};
+			std::vector<std::thread> workers {};
+			for (std::size_t t=1; t<nt; ++t) {
+				workers.emplace_back(work,t);
+			}
+			work(0);
+			for (auto& w : workers) {
+				w.join();
+			}
+			sha1_update_all(&ctx,h.data(),h.size());
+		} else {
+			ok = for_each_block(sf,pw_sha1_leaf_size,[&ctx](const uint8 *p, std::size_t n) -> void {
+				std::array<uint8,20> h {};
+				sha1_leaf(p,n,h.data());
+				sha1_update(&ctx,h.data(),20);
+			});
+		}
+	}
+	sha1_update(&ctx,reinterpret_cast<const uint8*>(seed.data()),static_cast<uint32>(seed.size()));
+	sha1_finish(&ctx,d.data());
+	return ok;
+}
+
+
+void put_be64(std::uint64_t x, std::uint8_t *p) {
+	for (int i=7; i>=0; --i, x >>= 8) {
+		p[i] = static_cast<std::uint8_t>(x);
+	}
 }
 
+// The padding of a 36-byte message is fixed, so the block is built once
+sha1_engine::sha1_engine(const sha1_digest_t& d, std::uint64_t stream) {
+	std::copy(d.begin(),d.end(),msg.begin());
+	put_be64(stream,msg.data()+20);
+	msg[36] = 0x80;
+	put_be64(36*8,msg.data()+56);
+}
 
-int pw_sha1_number(int max_num)
-{
-	int val;
+void sha1_engine::block(std::uint64_t k, std::uint32_t *dest) const {
+	auto m = msg;
+	put_be64(k,m.data()+28);
 	sha1_context ctx;
-	
-	if (sha1sum_idx>19) {
-		sha1sum_idx = 0;
-		sha1_update(&sha1_ctx, (unsigned char *) sha1_seed, 
-			    strlen(sha1_seed));
-		ctx = sha1_ctx;
-		sha1_finish(&ctx, sha1sum );
-	}
-	val = (int) (sha1sum[sha1sum_idx++] / ((float) 256) * max_num);
-	return (val);
+	sha1_starts(&ctx);
+	sha1_process(&ctx,m.data());
+	std::copy(ctx.state,ctx.state+5,dest);
+}
+
+void sha1_engine::seek(std::uint64_t s) {
+	put_be64(s,msg.data()+20);
+	counter = 0;
+	discard_buffer();
 }
 
-*/
+std::size_t sha1_engine::refill(std::uint32_t *dest, std::size_t n) {
+	const std::size_t nblocks = n/5;
+	for (std::size_t j=0; j<nblocks; ++j, ++counter) {
+		block(counter,dest+5*j);
+	}
+	return nblocks*5;
+}
+
+
+#if defined(TEST)
+
+#include <cstring>
+
+//
+// Known answers:  d for a file holding "abc" w/ an empty seed is SHA1("abc") (FIPS-180-1), 
+// and each engine block is the plain SHA-1 of d || stream || counter.  
+//
+int main() {
+	int nfail {0};
+	printf( "\n SHA-1 engine Validation Tests:\n\n" );
+
+	const char *path = "sha1num_test.tmp";
+	std::FILE *f = std::fopen(path,"wb");
+	std::fputs("abc",f);
+	std::fclose(f);
+
+	printf( " Test 1 (file digest) " );
+	sha1_digest_t d {};
+	const sha1_digest_t abc {0xa9,0x99,0x3e,0x36,0x47,0x06,0x81,0x6a,0xba,0x3e,
+		0x25,0x71,0x78,0x50,0xc2,0x6c,0x9c,0xd0,0xd8,0x9d};
+	if (!pw_sha1_init(std::string(path) + "#",d) || d != abc) {
+		printf( "failed!\n" );
+		++nfail;
+	} else {
+		printf( "passed.\n" );
+	}
+	std::remove(path);
+
+	printf( " Test 2 (engine blocks) " );
+	sha1_engine re(d,7);
+	bool ok {true};
+	for (std::uint64_t k=0; k<100; ++k) {
+		std::array<uint8,36> m {};
+		std::copy(d.begin(),d.end(),m.begin());
+		put_be64(7,m.data()+20);
+		put_be64(k,m.data()+28);
+		sha1_context ctx;
+		sha1_starts(&ctx);
+		sha1_update(&ctx,m.data(),static_cast<uint32>(m.size()));
+		std::array<uint8,20> expect {};
+		sha1_finish(&ctx,expect.data());
+		for (int i=0; i<5; ++i) {
+			const std::uint32_t w = re();
+			const std::uint32_t e = (std::uint32_t {expect[4*i]} << 24) | (expect[4*i+1] << 16) 
+				| (expect[4*i+2] << 8) | expect[4*i+3];
+			ok = ok && (w == e);
+		}
+	}
+	printf( ok ? "passed.\n" : "failed!\n" );
+	nfail += ok ? 0 : 1;
+
+	// SHA1(SHA1("abc") || 0 || 0), first word; fixes the layout against future changes
+	printf( " Test 3 (known block) " );
+	sha1_engine re0(abc,0);
+	if (re0() != 0x090fdb06u) {
+		printf( "failed!\n" );
+		++nfail;
+	} else {
+		printf( "passed.\n" );
+	}
+
+	// After a seek() the engine hands out the new stream from its first word
+	printf( " Test 4 (seek) " );
+	sha1_engine fresh(d,3);
+	re.seek(3);
+	ok = true;
+	for (int i=0; i<1000; ++i) {
+		ok = ok && (re() == fresh());
+	}
+	printf( ok ? "passed.\n" : "failed!\n" );
+	nfail += ok ? 0 : 1;
+
+	// 2.5 leaves:  the mapped file against the same bytes hashed from memory
+	std::vector<uint8> big(pw_sha1_leaf_size*5/2);
+	for (std::size_t i=0; i<big.size(); ++i) {
+		big[i] = static_cast<uint8>(i*2654435761u >> 13);
+	}
+	f = std::fopen(path,"wb");
+	std::fwrite(big.data(),1,big.size(),f);
+	std::fclose(f);
+
+	printf( " Test 5 (sequential digest) " );
+	sha1_context ctx;
+	sha1_starts(&ctx);
+	sha1_update_all(&ctx,big.data(),big.size());
+	sha1_update(&ctx,reinterpret_cast<const uint8*>("s"),1);
+	sha1_digest_t expect {};
+	sha1_finish(&ctx,expect.data());
+	ok = pw_sha1_init(std::string(path) + "#s",d) && d == expect;
+	printf( ok ? "passed.\n" : "failed!\n" );
+	nfail += ok ? 0 : 1;
+
+	printf( " Test 6 (tree digest) " );
+	sha1_starts(&ctx);
+	const uint8 tag {1};
+	sha1_update(&ctx,&tag,1);
+	for (std::size_t off=0; off<big.size(); off += pw_sha1_leaf_size) {
+		std::array<uint8,20> h {};
+		sha1_leaf(big.data()+off,std::min(pw_sha1_leaf_size,big.size()-off),h.data());
+		sha1_update(&ctx,h.data(),20);
+	}
+	sha1_update(&ctx,reinterpret_cast<const uint8*>("s"),1);
+	sha1_finish(&ctx,expect.data());
+	ok = true;
+	for (int nthreads : {1, 2, 8}) {
+		ok = ok && pw_sha1_init(std::string(path) + "#s",d,true,nthreads) && d == expect;
+	}
+	printf( ok ? "passed.\n" : "failed!\n" );
+	nfail += ok ? 0 : 1;
+	std::remove(path);
+	printf( "\n" );
+
+	return nfail == 0 ? 0 : 1;
+}
 
+#endif